@@ -0,0 +1,32 @@
+###############################################################################
+# Benchmark Platform Makefile Fragment for Cortex-M3
+#
+# Builds an image for QEMU's lm3s6965evb machine. Set BENCH_CLOCK to dwt to
+# take time stamps from the DWT cycle counter when running on silicon.
+###############################################################################
+
+BENCH_CLOCK ?= systick # systick/dwt
+BENCH_TICK_CYCLES ?= 10000 # SysTick clock cycles per kernel tick
+
+ifeq ($(strip $(TICKLESS_IDLE)), yes)
+$(error The Cortex-M3 benchmarks drive the tick themselves, set TICKLESS_IDLE to no)
+endif
+
+BENCH_PLATFORM_OBJECTS := startup.o bench_platform.o
+BENCH_IMAGE := $(BENCH_OBJ_DIR)/bench.elf
+
+BENCH_CFLAGS := -DBENCH_STACK_SIZE=1024 -DBENCH_FILLER_STACK_SIZE=256 \
+	-DBENCH_TICK_CYCLES=$(strip $(BENCH_TICK_CYCLES))
+ifeq ($(strip $(BENCH_CLOCK)), dwt)
+BENCH_CFLAGS += -DBENCH_CLOCK_DWT
+else ifneq ($(strip $(BENCH_CLOCK)), systick)
+$(error Unknown BENCH_CLOCK $(BENCH_CLOCK)!)
+endif
+
+BENCH_LINK_FLAGS := -mcpu=cortex-m3 -mthumb -nostartfiles -nostdlib \
+	-T cortex-m3/lm3s6965.ld
+BENCH_LINK_LIBS := -lgcc
+
+QEMU := qemu-system-arm
+BENCH_RUN := $(QEMU) -M lm3s6965evb -nographic -semihosting \
+	-icount shift=0 -kernel $(BENCH_IMAGE)
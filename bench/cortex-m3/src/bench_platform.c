@@ -0,0 +1,169 @@
+/*****************************************************************************
+ * bench_platform.c - Benchmark platform for Cortex-M3.
+ *
+ * Runs on QEMU's lm3s6965evb machine or on silicon. Also used for the
+ * Cortex-M4F, on QEMU's mps2-an386 machine. Output and exit use ARM
+ * semihosting, so a debugger with semihosting enabled is needed on silicon.
+ *
+ * SysTick drives the kernel tick. Time stamps are taken from the DWT cycle
+ * counter if BENCH_CLOCK_DWT is defined. Otherwise, e.g. under QEMU, which
+ * does not model the DWT, they are computed from the number of ticks and the
+ * SysTick counter. Run QEMU with -icount to make the SysTick time stamps,
+ * and thereby the results, deterministic.
+ *
+ *****************************************************************************/
+
+#include "rtos_types.h"
+#include "kernel_int.h"
+#include "bench_platform.h"
+
+/******************************************************************************
+ * Defines, constants and structs.
+ *****************************************************************************/
+
+/* SysTick clock cycles per kernel tick. */
+#ifndef BENCH_TICK_CYCLES
+#define BENCH_TICK_CYCLES 10000
+#endif
+
+#define VECTOR_SVC    ((volatile unsigned long *) 0x2000002C)
+#define VECTOR_SYSTICK ((volatile unsigned long *) 0x2000003C)
+
+#define SCB_ICSR      ((volatile unsigned long *) 0xE000ED04)
+#define SCB_SHPR3     ((volatile unsigned long *) 0xE000ED20)
+#define ICSR_PENDSTSET 0x04000000
+
+#define SYST_CSR      ((volatile unsigned long *) 0xE000E010)
+#define SYST_RVR      ((volatile unsigned long *) 0xE000E014)
+#define SYST_CVR      ((volatile unsigned long *) 0xE000E018)
+#define SYST_CSR_ENABLE    0x00000001
+#define SYST_CSR_TICKINT   0x00000002
+#define SYST_CSR_CLKSOURCE 0x00000004
+
+#define DEMCR         ((volatile unsigned long *) 0xE000EDFC)
+#define DEMCR_TRCENA  0x01000000
+#define DWT_CTRL      ((volatile unsigned long *) 0xE0001000)
+#define DWT_CYCCNT    ((volatile unsigned long *) 0xE0001004)
+#define DWT_CTRL_CYCCNTENA 0x00000001
+
+/* Semihosting operations. */
+#define SYS_WRITE0    0x04
+#define SYS_EXIT      0x18
+#define ADP_STOPPED_APPLICATION_EXIT 0x20026
+
+/******************************************************************************
+ * External Functions
+ *****************************************************************************/
+extern void rtos_init(void);
+
+/******************************************************************************
+ * Local Variables
+ */
+static volatile rtos_u32 tick_count = 0;
+
+
+static void semihosting_call(rtos_u32 operation, const void *argument)
+{
+   register rtos_u32 r0 asm("r0") = operation;
+   register const void *r1 asm("r1") = argument;
+
+   asm volatile("bkpt 0xAB" : "+r" (r0) : "r" (r1) : "memory");
+}
+
+/******************************************************************************
+ * Function: systick_handler
+ *
+ * SysTick exception handler. Counts ticks for the time stamps and advances
+ * the kernel tick.
+ */
+static void systick_handler(void)
+{
+   tick_count++;
+   rtos_tick_hook();
+}
+
+rtos_u32 bench_cycles(void)
+{
+#ifdef BENCH_CLOCK_DWT
+   return *DWT_CYCCNT;
+#else
+   rtos_u32 ticks = 0;
+   rtos_u32 counter = 0;
+
+   /* If the counter wraps while being read, the tick is pending but not yet
+      counted. */
+   asm volatile("cpsid i" ::: "memory");
+   ticks = tick_count;
+   counter = *SYST_CVR;
+   if ((*SCB_ICSR & ICSR_PENDSTSET) != 0)
+   {
+      ticks++;
+      counter = *SYST_CVR;
+   }
+   asm volatile("cpsie i" ::: "memory");
+
+   return ticks * BENCH_TICK_CYCLES + (BENCH_TICK_CYCLES - 1 - counter);
+#endif
+}
+
+const char *bench_cycle_unit(void)
+{
+#ifdef BENCH_CLOCK_DWT
+   return "cycles";
+#else
+   return "systick cycles";
+#endif
+}
+
+void bench_print(const char *text)
+{
+   semihosting_call(SYS_WRITE0, text);
+}
+
+void bench_exit(int status)
+{
+   (void) status;
+
+   semihosting_call(SYS_EXIT, (const void *) ADP_STOPPED_APPLICATION_EXIT);
+   for (;;);
+}
+
+/******************************************************************************
+ * Function: soc_start_hook
+ *
+ * Starts the kernel tick. SysTick gets the same, lowest, priority as PendSV,
+ * so that the tick never interrupts the kernel.
+ */
+void soc_start_hook(void)
+{
+#ifdef BENCH_CLOCK_DWT
+   *DEMCR |= DEMCR_TRCENA;
+   *DWT_CYCCNT = 0;
+   *DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+
+   *VECTOR_SYSTICK = (unsigned long) systick_handler;
+   *SCB_SHPR3 |= 0xFFFF0000;
+   *SYST_RVR = BENCH_TICK_CYCLES - 1;
+   *SYST_CVR = 0;
+   *SYST_CSR = SYST_CSR_CLKSOURCE | SYST_CSR_TICKINT | SYST_CSR_ENABLE;
+}
+
+/******************************************************************************
+ * Function: start_handler
+ *
+ * Temporary SVC handler that starts the kernel. rtos_init must be called in
+ * handler mode, as the kernel starts the first process with an exception
+ * return. arch_start replaces the SVC vector with the kernel's own.
+ */
+static void start_handler(void)
+{
+   rtos_init();
+}
+
+int main(void)
+{
+   *VECTOR_SVC = (unsigned long) start_handler;
+   asm volatile("svc 0" ::: "memory");
+   return 1;
+}
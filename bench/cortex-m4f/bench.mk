@@ -0,0 +1,33 @@
+###############################################################################
+# Benchmark Platform Makefile Fragment for Cortex-M4F
+#
+# Builds an image for QEMU's mps2-an386 machine, a Cortex-M4 with FPU. The
+# platform sources are those of the Cortex-M3, see cortex-m3/bench.mk.
+###############################################################################
+
+BENCH_CLOCK ?= systick # systick/dwt
+BENCH_TICK_CYCLES ?= 10000 # SysTick clock cycles per kernel tick
+
+ifeq ($(strip $(TICKLESS_IDLE)), yes)
+$(error The Cortex-M4F benchmarks drive the tick themselves, set TICKLESS_IDLE to no)
+endif
+
+BENCH_PLATFORM_DIR := cortex-m3
+BENCH_PLATFORM_OBJECTS := startup.o bench_platform.o
+BENCH_IMAGE := $(BENCH_OBJ_DIR)/bench.elf
+
+BENCH_CFLAGS := -DBENCH_STACK_SIZE=1024 -DBENCH_FILLER_STACK_SIZE=256 \
+	-DBENCH_TICK_CYCLES=$(strip $(BENCH_TICK_CYCLES))
+ifeq ($(strip $(BENCH_CLOCK)), dwt)
+BENCH_CFLAGS += -DBENCH_CLOCK_DWT
+else ifneq ($(strip $(BENCH_CLOCK)), systick)
+$(error Unknown BENCH_CLOCK $(BENCH_CLOCK)!)
+endif
+
+BENCH_LINK_FLAGS := $(CPU_FLAGS) -nostartfiles -nostdlib \
+	-T cortex-m4f/mps2_an386.ld
+BENCH_LINK_LIBS := -lgcc
+
+QEMU := qemu-system-arm
+BENCH_RUN := $(QEMU) -M mps2-an386 -nographic -semihosting \
+	-icount shift=0 -kernel $(BENCH_IMAGE)
@@ -0,0 +1,46 @@
+/*****************************************************************************
+ * bench_platform.h - Interface between the portable kernel benchmarks and
+ * the platform (BSP) that they run on.
+ *
+ * Each platform under bench/<arch>/ implements these functions, starts the
+ * kernel with rtos_init and provides soc_start_hook. The benchmark processes
+ * are created by rtos_hook_create_processes in bench.c.
+ *
+ *****************************************************************************/
+
+#ifndef BENCH_PLATFORM_H
+#define BENCH_PLATFORM_H
+
+#include "rtos_types.h"
+
+/******************************************************************************
+ * Function: bench_cycles
+ *
+ * Returns a free-running 32-bit time stamp. The unit is given by
+ * bench_cycle_unit. Only differences between time stamps are used, so the
+ * counter may wrap.
+ */
+extern rtos_u32 bench_cycles(void);
+
+/******************************************************************************
+ * Function: bench_cycle_unit
+ *
+ * Returns the name of the unit of bench_cycles, e.g. "cycles".
+ */
+extern const char *bench_cycle_unit(void);
+
+/******************************************************************************
+ * Function: bench_print
+ *
+ * Writes the zero-terminated string 'text' to the benchmark output.
+ */
+extern void bench_print(const char *text);
+
+/******************************************************************************
+ * Function: bench_exit
+ *
+ * Ends the benchmark run. Never returns.
+ */
+extern void bench_exit(int status);
+
+#endif
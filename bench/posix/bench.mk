@@ -0,0 +1,13 @@
+###############################################################################
+# Benchmark Platform Makefile Fragment for the posix architecture
+###############################################################################
+
+BENCH_PLATFORM_OBJECTS := bench_platform.o
+BENCH_IMAGE := $(BENCH_OBJ_DIR)/bench
+
+BENCH_CFLAGS := -DBENCH_STACK_SIZE=32768 -DBENCH_FILLER_STACK_SIZE=16384
+
+BENCH_LINK_FLAGS :=
+BENCH_LINK_LIBS :=
+
+BENCH_RUN := $(BENCH_IMAGE)
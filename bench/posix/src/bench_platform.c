@@ -0,0 +1,68 @@
+/*****************************************************************************
+ * bench_platform.c - Benchmark platform for the posix architecture.
+ *
+ * Time stamps are taken from the host's monotonic clock, in nanoseconds.
+ * The results therefore include host noise, such as the emulated tick
+ * signal and other load on the host, and are mostly useful for comparing
+ * kernel versions on the same machine.
+ *
+ *****************************************************************************/
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rtos_types.h"
+#include "bench_platform.h"
+
+/******************************************************************************
+ * External Functions
+ *****************************************************************************/
+extern void rtos_init(void);
+
+
+rtos_u32 bench_cycles(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (rtos_u32) now.tv_sec * 1000000000u + (rtos_u32) now.tv_nsec;
+}
+
+const char *bench_cycle_unit(void)
+{
+   return "ns";
+}
+
+void bench_print(const char *text)
+{
+   size_t length = strlen(text);
+   ssize_t written = 0;
+
+   while (length > 0)
+   {
+      written = write(STDOUT_FILENO, text, length);
+      if (written <= 0)
+      {
+         return;
+      }
+      text += written;
+      length -= (size_t) written;
+   }
+}
+
+void bench_exit(int status)
+{
+   exit(status);
+}
+
+void soc_start_hook(void)
+{
+}
+
+int main(void)
+{
+   rtos_init();
+   return 1;
+}
@@ -0,0 +1,691 @@
+/*****************************************************************************
+ * bench.c - Kernel microbenchmarks.
+ *
+ * Measures the cost of the basic kernel operations: context switch, with and
+ * without floating-point context, message round-trip, psem round-trip, send/receive at a given inbox depth,
+ * with and without message priority, batched send/receive, alloc/dispose, uncontended mutex lock/unlock and delay/tick. Each benchmark is run at a number of points
+ * of one parameter:
+ *
+ *  ready   - Number of extra processes in the ready-queue, at priorities
+ *            below the benchmark processes.
+ *  depth   - Number of messages already in the inbox.
+ *  bytes   - Requested buffer size.
+ *  batch   - Number of messages per batch.
+ *  delayed - Number of extra processes in the delaylist.
+ *
+ * A controller process at the highest priority runs the benchmarks one point
+ * at a time. It sets up the extra processes, starts two worker processes by
+ * signaling their psems and waits for the result. Worker A measures the time
+ * of BENCH_ITERATIONS iterations of the benchmark, worker B is its partner
+ * for benchmarks that need two processes.
+ *
+ * The result is written as CSV, one line per point, with the average cost of
+ * one operation in the unit of the platform's time stamp counter:
+ *
+ *  benchmark,parameter,value,cost
+ *
+ *****************************************************************************/
+
+#include "kernel.h"
+#include "bench_platform.h"
+
+/******************************************************************************
+ * Defines, constants and structs.
+ *****************************************************************************/
+
+#ifndef BENCH_ITERATIONS
+#define BENCH_ITERATIONS 1000
+#endif
+
+/* Stack sizes, set by the platform. */
+#ifndef BENCH_STACK_SIZE
+#define BENCH_STACK_SIZE 1024
+#endif
+#ifndef BENCH_FILLER_STACK_SIZE
+#define BENCH_FILLER_STACK_SIZE 256
+#endif
+
+#if RTOS_NBR_PRIORITIES < 4
+#error "The benchmarks need at least 4 priority levels"
+#endif
+
+#define CONTROLLER_PRIORITY 0
+#define WORKER_PRIORITY 1
+#define FILLER_PRIORITY_FIRST 2
+#define FILLER_PRIORITY_LAST (RTOS_NBR_PRIORITIES - 2)
+#define NBR_FILLER_PRIORITIES \
+   (FILLER_PRIORITY_LAST - FILLER_PRIORITY_FIRST + 1)
+
+/* Number of processes of each filler kind. */
+#define BENCH_MAX_FILLERS 32
+
+/* Delay of the delaylist fillers. Longer than any benchmark run. */
+#define BENCH_LONG_DELAY 0x10000000
+
+/* Inboxes of the controller. */
+#define RESULT_INBOX 0
+#define DONE_INBOX 1
+
+/* Inboxes of the workers. */
+#define PING_INBOX 0
+#define DEPTH_INBOX 1
+
+#define NBR_ELEMENTS(array) (sizeof(array) / sizeof((array)[0]))
+
+typedef enum
+{
+   PARAMETER_READY,
+   PARAMETER_DEPTH,
+   PARAMETER_BYTES,
+   PARAMETER_BATCH,
+   PARAMETER_DELAYED
+} Parameter;
+
+typedef struct Benchmark
+{
+      const char          *name;
+      Parameter           parameter;
+
+      /* Number of operations that one iteration is reported as. */
+      rtos_u32            ops_per_iteration;
+
+      /* Runs BENCH_ITERATIONS iterations in worker A, returning the elapsed
+         time. */
+      rtos_u32            (*run_a)(rtos_u32 value);
+
+      /* Partner loop run in worker B, or 0. */
+      void                (*run_b)(rtos_u32 value);
+} Benchmark;
+
+
+/******************************************************************************
+ * Function Declarations
+ *****************************************************************************/
+static rtos_u32 yield_run_a(rtos_u32 value);
+static void yield_run_b(rtos_u32 value);
+static rtos_u32 fp_yield_run_a(rtos_u32 value);
+static void fp_yield_run_b(rtos_u32 value);
+static rtos_u32 message_run_a(rtos_u32 value);
+static void message_run_b(rtos_u32 value);
+static rtos_u32 psem_run_a(rtos_u32 value);
+static void psem_run_b(rtos_u32 value);
+static rtos_u32 depth_run_a(rtos_u32 value);
+static rtos_u32 urgent_depth_run_a(rtos_u32 value);
+static rtos_u32 batch_run_a(rtos_u32 value);
+static rtos_u32 alloc_run_a(rtos_u32 value);
+static rtos_u32 mutex_run_a(rtos_u32 value);
+static rtos_u32 delay_run_a(rtos_u32 value);
+static void delay_run_b(rtos_u32 value);
+
+/******************************************************************************
+ * Local Variables
+ */
+
+static const char *parameter_names[] = { "ready", "depth", "bytes", "batch",
+                                          "delayed" };
+
+/* Parameter values of each sweep. The 'delayed' sweep must be last, as the
+   delaylist fillers stay delayed. */
+static const rtos_u32 ready_values[] = { 0, 1, 2, 4, 8, 16, 32 };
+static const rtos_u32 depth_values[] = { 0, 1, 4, 16, 64 };
+static const rtos_u32 bytes_values[] = { RTOS_BUFFER_SIZES };
+static const rtos_u32 batch_values[] = { 1, 4, 16, 64 };
+static const rtos_u32 delayed_values[] = { 0, 1, 4, 16, 32 };
+
+static const Benchmark benchmarks[] =
+{
+   /* A context switch through rtos_yield. */
+   { "yield_switch", PARAMETER_READY, 2, yield_run_a, yield_run_b },
+
+   /* As yield_switch, with both workers using floating point, so that their
+      FP context is switched on architectures with an FPU. */
+   { "fp_yield_switch", PARAMETER_READY, 2, fp_yield_run_a, fp_yield_run_b },
+
+   /* A message sent to worker B and back: two sends, two receives and two
+      context switches. */
+   { "message_round_trip", PARAMETER_READY, 1, message_run_a, message_run_b },
+
+   /* A psem signal to worker B and back: two signals, two waits and two
+      context switches. */
+   { "psem_round_trip", PARAMETER_READY, 1, psem_run_a, psem_run_b },
+
+   /* A send to the own inbox followed by a receive, without context
+      switch. */
+   { "send_receive_depth", PARAMETER_DEPTH, 1, depth_run_a, 0 },
+
+   /* As send_receive_depth, with a message of a higher priority than the
+      ones in the inbox, which overtakes them. */
+   { "urgent_send_receive_depth", PARAMETER_DEPTH, 1, urgent_depth_run_a, 0 },
+
+   /* An rtos_send_batch to the own inbox followed by an rtos_receive_all
+      of the whole batch, without context switch. Reported per message. */
+   { "batch_send_receive", PARAMETER_BATCH, 1, batch_run_a, 0 },
+
+   /* An rtos_alloc followed by an rtos_dispose. */
+   { "alloc_dispose", PARAMETER_BYTES, 1, alloc_run_a, 0 },
+
+   /* An rtos_mutex_lock followed by an rtos_mutex_unlock of a free
+      mutex. */
+   { "mutex_lock_unlock", PARAMETER_READY, 1, mutex_run_a, 0 },
+
+   /* An rtos_delay(1) ended by an rtos_tick from worker B: one delay, one
+      tick, one yield and two context switches. */
+   { "delay_tick_round_trip", PARAMETER_DELAYED, 1, delay_run_a, delay_run_b }
+};
+
+static rtos_u32 bench_mutex;
+static rtos_u32 controller_pid;
+static rtos_u32 worker_a_pid;
+static rtos_u32 worker_b_pid;
+static rtos_u32 ready_filler_pids[BENCH_MAX_FILLERS];
+static rtos_u32 delay_filler_pids[BENCH_MAX_FILLERS];
+static rtos_u32 nbr_delayed_fillers = 0;
+
+/* The benchmark point that the workers are to run. */
+static const Benchmark *current_benchmark = 0;
+static rtos_u32 current_value = 0;
+
+/* Tells worker B to keep ticking in the delay benchmark. */
+static volatile int delay_running = 0;
+
+
+/******************************************************************************
+ * Benchmarks
+ *****************************************************************************/
+
+static rtos_u32 yield_run_a(rtos_u32 value)
+{
+   rtos_u32 start = bench_cycles();
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_yield();
+   }
+   return bench_cycles() - start;
+}
+
+static void yield_run_b(rtos_u32 value)
+{
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_yield();
+   }
+}
+
+/******************************************************************************
+ * Function: fp_check
+ *
+ * Stops the benchmarks if a worker's floating-point sum is not what it
+ * should be, i.e. if its FP registers were not preserved by the context
+ * switches.
+ */
+static void fp_check(float sum, float step)
+{
+   if (sum != step * BENCH_ITERATIONS)
+   {
+      bench_print("fp_yield_switch: FP context corrupted\n");
+      bench_exit(1);
+   }
+}
+
+static rtos_u32 fp_yield_run_a(rtos_u32 value)
+{
+   rtos_u32 start = bench_cycles();
+   rtos_u32 elapsed = 0;
+   float sum = 0.0f;
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      sum += 1.0f;
+      rtos_yield();
+   }
+   elapsed = bench_cycles() - start;
+
+   fp_check(sum, 1.0f);
+   return elapsed;
+}
+
+static void fp_yield_run_b(rtos_u32 value)
+{
+   float sum = 0.0f;
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      sum += 2.0f;
+      rtos_yield();
+   }
+
+   fp_check(sum, 2.0f);
+}
+
+static rtos_u32 message_run_a(rtos_u32 value)
+{
+   rtos_address buffer = rtos_alloc(sizeof(rtos_u32));
+   rtos_u32 start = bench_cycles();
+   rtos_u32 elapsed = 0;
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_send(buffer, worker_b_pid, PING_INBOX);
+      buffer = rtos_receive(PING_INBOX);
+   }
+   elapsed = bench_cycles() - start;
+
+   rtos_dispose(buffer);
+   return elapsed;
+}
+
+static void message_run_b(rtos_u32 value)
+{
+   rtos_address buffer = 0;
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      buffer = rtos_receive(PING_INBOX);
+      rtos_send(buffer, worker_a_pid, PING_INBOX);
+   }
+}
+
+static rtos_u32 psem_run_a(rtos_u32 value)
+{
+   rtos_u32 start = bench_cycles();
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_signal_psem(worker_b_pid);
+      rtos_wait_psem();
+   }
+   return bench_cycles() - start;
+}
+
+static void psem_run_b(rtos_u32 value)
+{
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_wait_psem();
+      rtos_signal_psem(worker_a_pid);
+   }
+}
+
+static rtos_u32 depth_run_a(rtos_u32 depth)
+{
+   rtos_u32 pid = rtos_current_pid();
+   rtos_address buffer = 0;
+   rtos_u32 start = 0;
+   rtos_u32 elapsed = 0;
+   rtos_u32 i = 0;
+
+   for (i = 0; i < depth; i++)
+   {
+      rtos_send(rtos_alloc(sizeof(rtos_u32)), pid, DEPTH_INBOX);
+   }
+   buffer = rtos_alloc(sizeof(rtos_u32));
+
+   start = bench_cycles();
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_send(buffer, pid, DEPTH_INBOX);
+      buffer = rtos_receive(DEPTH_INBOX);
+   }
+   elapsed = bench_cycles() - start;
+
+   rtos_dispose(buffer);
+   for (i = 0; i < depth; i++)
+   {
+      rtos_dispose(rtos_receive(DEPTH_INBOX));
+   }
+   return elapsed;
+}
+
+static rtos_u32 urgent_depth_run_a(rtos_u32 depth)
+{
+   rtos_u32 pid = rtos_current_pid();
+   rtos_address buffer = 0;
+   rtos_u32 start = 0;
+   rtos_u32 elapsed = 0;
+   rtos_u32 i = 0;
+
+   for (i = 0; i < depth; i++)
+   {
+      rtos_send(rtos_alloc(sizeof(rtos_u32)), pid, DEPTH_INBOX);
+   }
+   buffer = rtos_alloc_priority(sizeof(rtos_u32), 1);
+
+   start = bench_cycles();
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_send(buffer, pid, DEPTH_INBOX);
+      buffer = rtos_receive(DEPTH_INBOX);
+   }
+   elapsed = bench_cycles() - start;
+
+   rtos_dispose(buffer);
+   for (i = 0; i < depth; i++)
+   {
+      rtos_dispose(rtos_receive(DEPTH_INBOX));
+   }
+   return elapsed;
+}
+
+static rtos_u32 batch_run_a(rtos_u32 batch_size)
+{
+   rtos_destination destination = { rtos_current_pid(), DEPTH_INBOX };
+   rtos_address buffers[64]; /* The largest of batch_values. */
+   rtos_u32 start = 0;
+   rtos_u32 elapsed = 0;
+   rtos_u32 i = 0;
+
+   for (i = 0; i < batch_size; i++)
+   {
+      buffers[i] = rtos_alloc(sizeof(rtos_u32));
+   }
+
+   start = bench_cycles();
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_send_batch(buffers, batch_size, &destination);
+      rtos_receive_all(DEPTH_INBOX, buffers, batch_size);
+   }
+   elapsed = bench_cycles() - start;
+
+   for (i = 0; i < batch_size; i++)
+   {
+      rtos_dispose(buffers[i]);
+   }
+   return elapsed / batch_size;
+}
+
+static rtos_u32 alloc_run_a(rtos_u32 nbr_bytes)
+{
+   rtos_u32 start = 0;
+   rtos_u32 i = 0;
+
+   /* Make sure that the pool holds a free buffer. */
+   rtos_dispose(rtos_alloc(nbr_bytes));
+
+   start = bench_cycles();
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_dispose(rtos_alloc(nbr_bytes));
+   }
+   return bench_cycles() - start;
+}
+
+static rtos_u32 mutex_run_a(rtos_u32 value)
+{
+   rtos_u32 start = bench_cycles();
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_mutex_lock(bench_mutex);
+      rtos_mutex_unlock(bench_mutex);
+   }
+   return bench_cycles() - start;
+}
+
+static rtos_u32 delay_run_a(rtos_u32 value)
+{
+   rtos_u32 start = 0;
+   rtos_u32 elapsed = 0;
+   rtos_u32 i = 0;
+
+   (void) value;
+
+   delay_running = 1;
+   start = bench_cycles();
+   for (i = 0; i < BENCH_ITERATIONS; i++)
+   {
+      rtos_delay(1);
+   }
+   elapsed = bench_cycles() - start;
+   delay_running = 0;
+
+   return elapsed;
+}
+
+static void delay_run_b(rtos_u32 value)
+{
+   (void) value;
+
+   while (delay_running)
+   {
+      rtos_tick();
+      rtos_yield();
+   }
+}
+
+
+/******************************************************************************
+ * Output
+ *****************************************************************************/
+
+static void print_u32(rtos_u32 value)
+{
+   char text[11];
+   char *digit = &text[10];
+
+   *digit = '\0';
+   do
+   {
+      *--digit = (char) ('0' + value % 10);
+      value /= 10;
+   } while (value != 0);
+
+   bench_print(digit);
+}
+
+static void print_result(const Benchmark *benchmark, rtos_u32 value,
+                         rtos_u32 elapsed)
+{
+   bench_print(benchmark->name);
+   bench_print(",");
+   bench_print(parameter_names[benchmark->parameter]);
+   bench_print(",");
+   print_u32(value);
+   bench_print(",");
+   print_u32(elapsed /
+             (BENCH_ITERATIONS * benchmark->ops_per_iteration));
+   bench_print("\n");
+}
+
+
+/******************************************************************************
+ * Processes
+ *****************************************************************************/
+
+/******************************************************************************
+ * Function: run_point
+ *
+ * Runs one benchmark at one parameter value and prints the result.
+ */
+static void run_point(const Benchmark *benchmark, rtos_u32 value)
+{
+   rtos_address result = 0;
+   rtos_u32 i = 0;
+
+   if (benchmark->parameter == PARAMETER_DELAYED)
+   {
+      while (nbr_delayed_fillers < value)
+      {
+         rtos_signal_psem(delay_filler_pids[nbr_delayed_fillers++]);
+      }
+   }
+
+   /* Let all lower priority processes settle, i.e. the ready fillers of the
+      last point go back to waiting and new delay fillers enter the
+      delaylist. A delay of two ticks lasts at least one whole tick. */
+   rtos_delay(2);
+
+   if (benchmark->parameter == PARAMETER_READY)
+   {
+      for (i = 0; i < value; i++)
+      {
+         rtos_signal_psem(ready_filler_pids[i]);
+      }
+   }
+
+   current_benchmark = benchmark;
+   current_value = value;
+   rtos_signal_psem(worker_a_pid);
+   rtos_signal_psem(worker_b_pid);
+
+   result = rtos_receive(RESULT_INBOX);
+   rtos_dispose(rtos_receive(DONE_INBOX));
+
+   print_result(benchmark, value, *(rtos_u32 *) result);
+   rtos_dispose(result);
+}
+
+static void controller(void)
+{
+   const rtos_u32 *values = 0;
+   rtos_u32 nbr_values = 0;
+   rtos_u32 benchmark = 0;
+   rtos_u32 value = 0;
+
+   bench_print("# iterations: ");
+   print_u32(BENCH_ITERATIONS);
+   bench_print(", unit: ");
+   bench_print(bench_cycle_unit());
+   bench_print("\nbenchmark,parameter,value,cost\n");
+
+   for (benchmark = 0; benchmark < NBR_ELEMENTS(benchmarks); benchmark++)
+   {
+      switch (benchmarks[benchmark].parameter)
+      {
+      case PARAMETER_READY:
+         values = ready_values;
+         nbr_values = NBR_ELEMENTS(ready_values);
+         break;
+      case PARAMETER_DEPTH:
+         values = depth_values;
+         nbr_values = NBR_ELEMENTS(depth_values);
+         break;
+      case PARAMETER_BYTES:
+         values = bytes_values;
+         nbr_values = NBR_ELEMENTS(bytes_values);
+         break;
+      case PARAMETER_BATCH:
+         values = batch_values;
+         nbr_values = NBR_ELEMENTS(batch_values);
+         break;
+      default:
+         values = delayed_values;
+         nbr_values = NBR_ELEMENTS(delayed_values);
+         break;
+      }
+
+      for (value = 0; value < nbr_values; value++)
+      {
+         run_point(&benchmarks[benchmark], values[value]);
+      }
+   }
+
+   bench_exit(0);
+}
+
+static void worker_a(void)
+{
+   rtos_address result = 0;
+
+   for (;;)
+   {
+      rtos_wait_psem();
+      result = rtos_alloc(sizeof(rtos_u32));
+      *(rtos_u32 *) result = current_benchmark->run_a(current_value);
+      rtos_send(result, controller_pid, RESULT_INBOX);
+   }
+}
+
+static void worker_b(void)
+{
+   for (;;)
+   {
+      rtos_wait_psem();
+      if (current_benchmark->run_b != 0)
+      {
+         current_benchmark->run_b(current_value);
+      }
+      rtos_send(rtos_alloc(sizeof(rtos_u32)), controller_pid, DONE_INBOX);
+   }
+}
+
+/* Occupies a place in the ready-queue while signaled. */
+static void ready_filler(void)
+{
+   for (;;)
+   {
+      rtos_wait_psem();
+   }
+}
+
+/* Occupies a place in the delaylist once signaled. */
+static void delay_filler(void)
+{
+   for (;;)
+   {
+      rtos_wait_psem();
+      rtos_delay(BENCH_LONG_DELAY);
+   }
+}
+
+
+/******************************************************************************
+ * Function: rtos_hook_create_processes
+ *
+ * Creates the benchmark processes. The fillers are spread over the
+ * priorities below the workers.
+ */
+void rtos_hook_create_processes(void)
+{
+   rtos_u32 i = 0;
+
+   bench_mutex = rtos_create_mutex();
+   controller_pid = rtos_create_process((rtos_address) controller,
+                                        BENCH_STACK_SIZE, CONTROLLER_PRIORITY);
+   worker_a_pid = rtos_create_process((rtos_address) worker_a,
+                                      BENCH_STACK_SIZE, WORKER_PRIORITY);
+   worker_b_pid = rtos_create_process((rtos_address) worker_b,
+                                      BENCH_STACK_SIZE, WORKER_PRIORITY);
+
+   for (i = 0; i < BENCH_MAX_FILLERS; i++)
+   {
+      ready_filler_pids[i] =
+         rtos_create_process((rtos_address) ready_filler,
+                             BENCH_FILLER_STACK_SIZE,
+                             FILLER_PRIORITY_FIRST + i % NBR_FILLER_PRIORITIES);
+      delay_filler_pids[i] =
+         rtos_create_process((rtos_address) delay_filler,
+                             BENCH_FILLER_STACK_SIZE,
+                             FILLER_PRIORITY_FIRST + i % NBR_FILLER_PRIORITIES);
+   }
+}
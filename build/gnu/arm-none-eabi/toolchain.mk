@@ -0,0 +1,38 @@
+###############################################################################
+# RTOS Specific Toolchain Makefile Fragment
+#
+# A current GNU Arm Embedded toolchain. Unlike codesourcery/arm-2010q1, it
+# supports the Cortex-M4 and its FPU. The CPU is selected by CPU_FLAGS, set
+# by the build variant in config.mk.
+###############################################################################
+
+CC := arm-none-eabi-gcc
+AS := arm-none-eabi-gcc
+LD := arm-none-eabi-ld
+CPP := arm-none-eabi-cpp
+AR := arm-none-eabi-ar
+
+ifeq ($(strip $(CPU_FLAGS)),)
+$(error No CPU_FLAGS selected!)
+endif
+
+ifeq ($(strip $(OPTIMIZE)), yes)
+OPTIMIZATION_FLAGS := -O3
+else ifeq ($(strip $(OPTIMIZE)), no)
+OPTIMIZATION_FLAGS := -O0
+else
+$(error No optimization level selected!)
+endif
+
+ifeq ($(strip $(DEBUG)), yes)
+DEBUG_FLAGS := -g
+else ifeq ($(strip $(DEBUG)), no)
+DEBUG_FLAGS :=
+else
+$(error No debug level selected!)
+endif
+
+CFLAGS += -c $(OPTIMIZATION_FLAGS) $(DEBUG_FLAGS) -fno-common $(CPU_FLAGS)
+ASFLAGS += -c $(CPU_FLAGS)
+CPPFLAGS += -P
+ARFLAGS += r
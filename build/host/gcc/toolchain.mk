@@ -0,0 +1,33 @@
+###############################################################################
+# RTOS Specific Toolchain Makefile Fragment
+#
+# Native toolchain, used for building the kernel for the posix architecture.
+# Extra flags, e.g. for sanitizers or profiling, can be given in HOST_CFLAGS.
+###############################################################################
+
+CC := gcc
+AS := gcc
+LD := ld
+CPP := cpp
+AR := ar
+
+ifeq ($(strip $(OPTIMIZE)), yes)
+OPTIMIZATION_FLAGS := -O3
+else ifeq ($(strip $(OPTIMIZE)), no)
+OPTIMIZATION_FLAGS := -O0
+else
+$(error No optimization level selected!)
+endif
+
+ifeq ($(strip $(DEBUG)), yes)
+DEBUG_FLAGS := -g
+else ifeq ($(strip $(DEBUG)), no)
+DEBUG_FLAGS :=
+else
+$(error No debug level selected!)
+endif
+
+CFLAGS += -c $(OPTIMIZATION_FLAGS) $(DEBUG_FLAGS) -fno-common $(HOST_CFLAGS)
+ASFLAGS += -c
+CPPFLAGS += -P
+ARFLAGS += r
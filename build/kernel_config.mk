@@ -0,0 +1,156 @@
+###############################################################################
+# RTOS Kernel Configuration Makefile Fragment
+#
+# Translates the kernel configuration variables set in config.mk into
+# preprocessor flags for the portable and architecture specific parts of
+# the kernel.
+###############################################################################
+
+RTOS_CONFIG_CFLAGS :=
+RTOS_CONFIG_ASFLAGS :=
+
+ifeq ($(strip $(NBR_PRIORITIES)),)
+$(error No number of priorities selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_NBR_PRIORITIES=$(strip $(NBR_PRIORITIES))
+RTOS_CONFIG_CFLAGS += -DRTOS_IDLE_STACK_SIZE=$(strip $(IDLE_STACK_SIZE))
+
+# With several cores, each core runs the processes created for it from a
+# ready-queue of its own, and the kernel data shared between the cores is
+# protected by spinlocks, see portable/src/kernel.c. The posix architecture
+# emulates the cores with host threads. The PCB has a lock, so applications
+# that include pcb.h need this flag too.
+ifeq ($(filter 1 2 3 4 5 6 7 8, $(strip $(NBR_CORES))),)
+$(error No number of cores (1-8) selected!)
+endif
+ifneq ($(strip $(NBR_CORES)), 1)
+ifneq ($(ARCH), posix)
+$(error Several cores are only supported on the posix architecture!)
+endif
+ifeq ($(strip $(TICKLESS_IDLE)), yes)
+$(error Tickless idle is not supported with several cores!)
+endif
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_NBR_CORES=$(strip $(NBR_CORES))
+
+# With tickless idle, the kernel drives the tick from the architecture's tick
+# timer and the BSP must not call rtos_tick.
+ifeq ($(strip $(TICKLESS_IDLE)), yes)
+RTOS_CONFIG_CFLAGS += -DRTOS_TICKLESS_IDLE \
+	-DRTOS_TICK_CYCLES=$(strip $(TICK_CYCLES))
+else ifneq ($(strip $(TICKLESS_IDLE)), no)
+$(error No tickless idle mode selected!)
+endif
+
+# With time slicing, a process that has run for TIME_SLICE ticks is put
+# behind the ready processes of its priority, see rtos_reschedule_hook.
+ifeq ($(strip $(TIME_SLICE)),)
+$(error No time slice selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_TIME_SLICE=$(strip $(TIME_SLICE))
+
+# Integrity checks, see RTOS_CHECK_LEVEL in portable/src/kernel.c.
+ifeq ($(filter 0 1 2, $(strip $(CHECK_LEVEL))),)
+$(error No check level (0-2) selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_CHECK_LEVEL=$(strip $(CHECK_LEVEL))
+
+ifeq ($(strip $(BUFFER_SIZES)),)
+$(error No buffer sizes selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_BUFFER_SIZES=$(strip $(BUFFER_SIZES))
+RTOS_CONFIG_CFLAGS += -DRTOS_BUFFER_PREALLOC=$(strip $(BUFFER_PREALLOC))
+
+# Inboxes per process. The PCB has the inboxes, so applications that include
+# pcb.h need this flag too.
+INBOX_COUNTS := 1 2 3 4 5 6 7 8 9 10 11 12 13 14 15 16 17 18 19 20 21 22 23 \
+	24 25 26 27 28 29 30 31 32
+ifeq ($(filter $(INBOX_COUNTS), $(strip $(NBR_INBOXES))),)
+$(error No number of inboxes (1-32) selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_NBR_INBOXES=$(strip $(NBR_INBOXES))
+
+# Message priorities, see rtos_alloc_priority in include/kernel.h. The PCB
+# has an inbox tail per priority, so applications that include pcb.h, such
+# as the static configuration, need this flag too.
+ifeq ($(filter 1 2 3 4 5 6 7 8, $(strip $(MESSAGE_PRIORITIES))),)
+$(error No number of message priorities (1-8) selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_MESSAGE_PRIORITIES=$(strip $(MESSAGE_PRIORITIES))
+
+# With tracing, the kernel records events in a ring buffer, see
+# include/rtos_trace.h.
+ifeq ($(strip $(TRACE)), yes)
+RTOS_CONFIG_CFLAGS += -DRTOS_TRACE \
+	-DRTOS_TRACE_RECORDS=$(strip $(TRACE_RECORDS))
+else ifneq ($(strip $(TRACE)), no)
+$(error No trace mode selected!)
+endif
+
+# With the critical-section profiler, the kernel measures how long it masks
+# interrupts at each site, see include/rtos_critical.h. The assembly parts
+# of the kernel have sites too.
+ifeq ($(strip $(CRITICAL_PROFILE)), yes)
+RTOS_CONFIG_CFLAGS += -DRTOS_CRITICAL_PROFILE
+RTOS_CONFIG_ASFLAGS += -DRTOS_CRITICAL_PROFILE
+else ifneq ($(strip $(CRITICAL_PROFILE)), no)
+$(error No critical-section profiler mode selected!)
+endif
+
+# With process statistics, the kernel accounts the time each process runs at
+# the context switch and paints the stacks to find their high-water marks,
+# see rtos_process_stats in include/kernel.h.
+ifeq ($(strip $(PROCESS_STATS)), yes)
+RTOS_CONFIG_CFLAGS += -DRTOS_PROCESS_STATS
+else ifneq ($(strip $(PROCESS_STATS)), no)
+$(error No process statistics mode selected!)
+endif
+
+# With buffer statistics, the kernel counts the buffers of each pool and
+# records the owner of each buffer, see rtos_pool_stats and
+# rtos_buffers_held in include/kernel.h. The owner is in the buffer header,
+# and the number of buffers held in the PCB.
+ifeq ($(strip $(BUFFER_STATS)), yes)
+RTOS_CONFIG_CFLAGS += -DRTOS_BUFFER_STATS
+else ifneq ($(strip $(BUFFER_STATS)), no)
+$(error No buffer statistics mode selected!)
+endif
+
+# With deferred work queues, interrupt handlers post work items with
+# rtos_defer_from_isr, see include/kernel.h, and a kernel process at
+# WORK_PRIORITY runs them.
+ifeq ($(filter 0 1 2 3 4 5 6 7 8, $(strip $(WORK_QUEUES))),)
+$(error No number of work queues (0-8) selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_WORK_QUEUES=$(strip $(WORK_QUEUES))
+ifneq ($(strip $(WORK_QUEUES)), 0)
+ifeq ($(filter 2 4 8 16 32 64 128 256, $(strip $(WORK_QUEUE_ITEMS))),)
+$(error No number of work queue items (a power of 2, 2-256) selected!)
+endif
+RTOS_CONFIG_CFLAGS += -DRTOS_WORK_QUEUE_ITEMS=$(strip $(WORK_QUEUE_ITEMS)) \
+	-DRTOS_WORK_PRIORITY=$(strip $(WORK_PRIORITY)) \
+	-DRTOS_WORK_STACK_SIZE=$(strip $(WORK_STACK_SIZE))
+endif
+
+# With the static configuration, the processes, mutexes, event groups and
+# preallocated buffers come from tables that the application generates with
+# tools/conf_gen.py in its conf_gen rule, instead of being created at boot,
+# see include/rtos_static.h. BUFFER_PREALLOC is then not used. CONF_GEN runs
+# the generator with the settings above:
+#
+#   conf_gen:
+#   	$(CONF_GEN) app.conf -o obj/app_conf
+ifeq ($(strip $(STATIC_CONFIG)), yes)
+RTOS_CONFIG_CFLAGS += -DRTOS_STATIC_CONFIG
+else ifneq ($(strip $(STATIC_CONFIG)), no)
+$(error No static configuration mode selected!)
+endif
+
+CONF_GEN := python3 $(RTOS_ROOT)/tools/conf_gen.py \
+	--buffer-sizes=$(strip $(BUFFER_SIZES)) \
+	--nbr-priorities=$(strip $(NBR_PRIORITIES)) \
+	--nbr-cores=$(strip $(NBR_CORES)) \
+	--idle-stack-size=$(strip $(IDLE_STACK_SIZE)) \
+	--work-queues=$(strip $(WORK_QUEUES)) \
+	--work-priority=$(strip $(WORK_PRIORITY)) \
+	--work-stack-size=$(strip $(WORK_STACK_SIZE))
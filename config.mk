@@ -10,19 +10,66 @@
 # Find out RTOS_ROOT:
 RTOS_ROOT := $(realpath $(dir $(lastword $(MAKEFILE_LIST))))
 
-# Define the architecture and build type:
-RTOS_BUILD_VARIANT := CORTEX_M3_DEBUG
+# Define the architecture and build type. The build variant can be selected
+# on the command line, e.g. "make RTOS_BUILD_VARIANT=POSIX_DEBUG".
+RTOS_BUILD_VARIANT ?= CORTEX_M3_DEBUG
+
+ifeq ($(RTOS_BUILD_VARIANT), CORTEX_M3_DEBUG)
 ARCH := cortex-m3
 DEBUG := yes # yes/no
 OPTIMIZE := no # yes/no
-
 # Define the toolchain to use:
 RTOS_TOOLCHAIN := codesourcery/arm-2010q1
+IDLE_STACK_SIZE := 256 # Stack size in bytes of the kernel idle process
+WORK_STACK_SIZE := 512 # Stack size in bytes of the kernel work process
+else ifeq ($(RTOS_BUILD_VARIANT), CORTEX_M4F_DEBUG)
+# Cortex-M4F with hardware floating point, e.g. QEMU's mps2-an386 machine.
+ARCH := cortex-m4f
+DEBUG := yes # yes/no
+OPTIMIZE := no # yes/no
+RTOS_TOOLCHAIN := gnu/arm-none-eabi
+CPU_FLAGS := -mcpu=cortex-m4 -mthumb -mfloat-abi=hard -mfpu=fpv4-sp-d16
+IDLE_STACK_SIZE := 256 # Stack size in bytes of the kernel idle process
+WORK_STACK_SIZE := 512 # Stack size in bytes of the kernel work process
+else ifeq ($(RTOS_BUILD_VARIANT), POSIX_DEBUG)
+# Native Linux build, running the kernel in a host process.
+ARCH := posix
+DEBUG := yes # yes/no
+OPTIMIZE := no # yes/no
+RTOS_TOOLCHAIN := host/gcc
+IDLE_STACK_SIZE := 16384 # Stack size in bytes of the kernel idle process
+WORK_STACK_SIZE := 16384 # Stack size in bytes of the kernel work process
+else
+$(error Unknown build variant $(RTOS_BUILD_VARIANT)!)
+endif
+
+# Kernel configuration:
+NBR_PRIORITIES := 32 # 2-32, 0 is the highest, the lowest is for idle
+NBR_CORES := 1 # 1-8, more than 1 only on posix, one host thread per core
+TIME_SLICE := 0 # Ticks before a process gives way to its equal-priority peers, 0: off
+TICKLESS_IDLE := no # yes/no, if yes the kernel owns the tick timer
+TICK_CYCLES := 72000 # Tick timer clock cycles per tick, for tickless idle
+BUFFER_SIZES := 16,64,512 # Buffer sizes in bytes, ascending, multiples of 4
+BUFFER_PREALLOC := 0,0,0 # Buffers of each size to allocate at start-up
+NBR_INBOXES := 4 # 1-32, inboxes per process
+MESSAGE_PRIORITIES := 4 # 1-8, inboxes deliver more urgent messages first
+CHECK_LEVEL := 1 # 0: none, 1: cheap asserts, 2: asserts and idle-time audit
+TRACE := no # yes/no, record kernel events in the rtos_trace buffer
+TRACE_RECORDS := 256 # Trace buffer size in 8-byte records, a power of 2
+CRITICAL_PROFILE := no # yes/no, measure the time interrupts are masked
+PROCESS_STATS := no # yes/no, per-process CPU time and stack high-water mark
+BUFFER_STATS := no # yes/no, buffer pool usage and buffers held per process
+WORK_QUEUES := 0 # 0-8, deferred work queues, one per interrupt posting work
+WORK_QUEUE_ITEMS := 16 # Work items per queue, a power of 2
+WORK_PRIORITY := 0 # Priority of the kernel process that runs deferred work
+STATIC_CONFIG := no # yes/no, processes etc. from tools/conf_gen.py output
 
 # Toolchain setup:
 include $(RTOS_ROOT)/build/build.mk
 # Miscellaneous build support:
 include $(RTOS_ROOT)/build/misc.mk
+# Kernel configuration flags:
+include $(RTOS_ROOT)/build/kernel_config.mk
 # Make rules common to many components:
 include $(RTOS_ROOT)/build/rules.mk
 
@@ -7,16 +7,78 @@
 #ifndef KERNEL_ARCH_H
 #define KERNEL_ARCH_H
 
+#include "rtos_types.h"
+
 /* Macros to disable/enable interrupts with a priority less than or equal to
    8. Interrupt with a priority higher than 8 may not call API functions in
    the kernel, as that might corrupt internal data structures.
+   INTERRUPT_DISABLE_SAVE saves the current mask in 'saved', an rtos_u32,
+   and INTERRUPT_ENABLE_SAVED restores it, so critical sections nest. As
+   BASEPRI_MAX only raises the mask, a section nested in one that masks more
+   does not unmask anything.
    TODO: These macros assume that 4 bits are used for representing a priority.
    This number varies with different implementations of Cortex-M3. 4 bits are
    used for the STM32. */
-#define INTERRUPT_DISABLE						\
-   do { asm volatile("mov r12, 0x00000080\n\tmsr BASEPRI, r12":::"r12"); } while(0)
+#define INTERRUPT_DISABLE_SAVE(saved)					\
+   do { asm volatile("mrs %0, BASEPRI\n\tmov r12, 0x00000080\n\t"	\
+                     "msr BASEPRI_MAX, r12"				\
+                     : "=r" (saved) :: "r12", "memory"); } while(0)
+
+#define INTERRUPT_ENABLE_SAVED(saved) \
+   do { asm volatile("msr BASEPRI, %0" :: "r" (saved) : "memory"); } while(0)
+
+/* Macros to mask/unmask all configurable interrupts using PRIMASK. Used by
+   the idle process around sleeping, as a masked interrupt that becomes
+   pending still wakes the CPU from WFI when masked by PRIMASK, but not when
+   masked by BASEPRI. */
+#define INTERRUPT_MASK_ALL \
+   do { asm volatile("cpsid i" ::: "memory"); } while(0)
+
+#define INTERRUPT_UNMASK_ALL \
+   do { asm volatile("cpsie i" ::: "memory"); } while(0)
+
+/* Sleep until an interrupt becomes pending. */
+#define WAIT_FOR_INTERRUPT \
+   do { asm volatile("dsb\n\twfi\n\tisb" ::: "memory"); } while(0)
+
+/* End of the memory that the kernel allocates PCBs, stacks and buffers
+   from, which starts at _kernel_pool_start. Both are set up by the linker
+   script, which must define _kernel_pool_end as well as _kernel_pool_start,
+   usually as the end of RAM, as the linker scripts of the benchmarks do.
+   Allocations beyond it fail. */
+extern rtos_address _kernel_pool_end[];
+#define ARCH_KERNEL_POOL_END ((rtos_address) _kernel_pool_end)
+
+/* Time stamp for trace records, the critical-section profiler and the
+   process statistics: the DWT cycle counter, started by arch_start when any
+   of them is configured. It counts core clock cycles, so the frequency
+   depends on the board. A board without the DWT may define both macros in
+   its CFLAGS to use a free-running timer of its own instead. */
+#ifndef RTOS_TRACE_TIMESTAMP
+#define RTOS_TRACE_TIMESTAMP() (*(volatile rtos_u32 *) 0xE0001004)
+#endif
+
+#ifndef RTOS_TRACE_TIMESTAMP_HZ
+#define RTOS_TRACE_TIMESTAMP_HZ 72000000
+#endif
+
+/* Orders the memory accesses before it before those after it, for the
+   data that interrupt handlers share with the kernel without masking
+   interrupts, such as the deferred work queues. */
+#define ARCH_MEMORY_BARRIER() \
+   do { asm volatile("dmb" ::: "memory"); } while(0)
+
+/* The kernel supports a single core only on this architecture. */
+#define ARCH_CORE_ID() 0
 
-#define INTERRUPT_ENABLE \
-   do { asm volatile("mov r12, 0x00000000\n\tmsr BASEPRI, r12":::"r12"); } while(0)
+/* Count leading zeros of 'value' using the CLZ instruction. The result is 32
+   if 'value' is zero. Used by the portable kernel to find the highest
+   priority in the ready-queue bitmap in constant time. */
+static inline rtos_u32 arch_clz(rtos_u32 value)
+{
+   rtos_u32 result;
+   asm ("clz %0, %1" : "=r" (result) : "r" (value));
+   return result;
+}
 
 #endif
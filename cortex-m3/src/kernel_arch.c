@@ -1,10 +1,56 @@
 #include "pcb.h"
+#include "kernel_int.h"
+#include "kernel_arch.h"
 
 /******************************************************************************
  * Defines, constants and structs.
  *****************************************************************************/
 #define VECTOR_SVC    ((volatile unsigned long *) 0x2000002C)
 #define VECTOR_PENDSV ((volatile unsigned long *) 0x20000038)
+#define VECTOR_SYSTICK ((volatile unsigned long *) 0x2000003C)
+
+/* System handler priority register 3, holding the PendSV and SysTick
+   priorities. */
+#define SCB_SHPR3     ((volatile unsigned long *) 0xE000ED20)
+#define SCB_ICSR      ((volatile unsigned long *) 0xE000ED04)
+#define ICSR_PENDSTSET 0x04000000
+
+/* SysTick registers. */
+#define SYST_CSR      ((volatile unsigned long *) 0xE000E010)
+#define SYST_RVR      ((volatile unsigned long *) 0xE000E014)
+#define SYST_CVR      ((volatile unsigned long *) 0xE000E018)
+#define SYST_CSR_ENABLE    0x00000001
+#define SYST_CSR_TICKINT   0x00000002
+#define SYST_CSR_CLKSOURCE 0x00000004
+#define SYST_CSR_COUNTFLAG 0x00010000
+#define SYST_MAX_RELOAD    0x00FFFFFF
+
+/* DWT cycle counter, used for trace time stamps and profiling. */
+#define DEMCR         ((volatile unsigned long *) 0xE000EDFC)
+#define DEMCR_TRCENA  0x01000000
+#define DWT_CTRL      ((volatile unsigned long *) 0xE0001000)
+#define DWT_CTRL_CYCCNTENA 0x00000001
+
+#ifdef __ARM_FP
+/* Cortex-M4F: coprocessor access control and FP context control. With
+   ASPEN, the hardware stacks s0-s15 and FPSCR on exception entry if the
+   interrupted process has used the FPU, and with LSPEN it only reserves the
+   space and saves the registers when the handler itself uses the FPU. */
+#define SCB_CPACR     ((volatile unsigned long *) 0xE000ED88)
+#define CPACR_CP10_CP11_FULL 0x00F00000
+#define FPU_FPCCR     ((volatile unsigned long *) 0xE000EF34)
+#define FPCCR_ASPEN   0x80000000
+#define FPCCR_LSPEN   0x40000000
+#endif
+
+#ifdef RTOS_TICKLESS_IDLE
+#if RTOS_TICK_CYCLES < 2 || RTOS_TICK_CYCLES > SYST_MAX_RELOAD + 1
+#error "RTOS_TICK_CYCLES does not fit in SysTick"
+#endif
+
+/* The longest sleep that fits in the 24-bit SysTick counter. */
+#define MAX_SLEEP_TICKS ((SYST_MAX_RELOAD + 1) / RTOS_TICK_CYCLES)
+#endif
 
 
 /******************************************************************************
@@ -39,8 +85,128 @@ void arch_start(PCB *pcb)
    *VECTOR_SVC = (unsigned long) CM3_handler_svc;
    *VECTOR_PENDSV = (unsigned long) CM3_handler_pendsv;
 
+#ifdef __ARM_FP
+   /* Enable the FPU with lazy stacking, which the context switch in
+      cortex-m4f relies on to save s16-s31 only for processes that use the
+      FPU. */
+   *SCB_CPACR |= CPACR_CP10_CP11_FULL;
+   *FPU_FPCCR |= FPCCR_ASPEN | FPCCR_LSPEN;
+   asm volatile("dsb\n\tisb" ::: "memory");
+#endif
+
+#if defined(RTOS_TRACE) || defined(RTOS_CRITICAL_PROFILE) || \
+   defined(RTOS_PROCESS_STATS)
+   /* Start the cycle counter for the trace time stamps. */
+   *DEMCR |= DEMCR_TRCENA;
+   *DWT_CTRL |= DWT_CTRL_CYCCNTENA;
+#endif
+
+#ifdef RTOS_TICKLESS_IDLE
+   /* The kernel owns SysTick. Give it the same priority as PendSV, so that
+      the tick handler never interrupts the kernel, and start it. */
+   *VECTOR_SYSTICK = (unsigned long) rtos_tick_hook;
+   *SCB_SHPR3 = (*SCB_SHPR3 & 0x00FFFFFF) | ((*SCB_SHPR3 & 0x00FF0000) << 8);
+   *SYST_RVR = RTOS_TICK_CYCLES - 1;
+   *SYST_CVR = 0;
+   *SYST_CSR = SYST_CSR_CLKSOURCE | SYST_CSR_TICKINT | SYST_CSR_ENABLE;
+#endif
+
    /* Now, return from handler mode to thread mode, running the process
       referred to by 'pcb'. */
    start_process(pcb);
 }
 
+
+#ifdef RTOS_TICKLESS_IDLE
+/******************************************************************************
+ * Function: arch_tickless_sleep
+ *
+ * Reprograms SysTick as a one-shot timer that expires at the end of tick
+ * period number 'max_ticks', counted from the last tick, and sleeps. When
+ * woken, SysTick is restarted with the remainder of the current tick period
+ * followed by normal periods. Called with all interrupts masked.
+ *
+ * If the one-shot timer expired, its SysTick exception is pending and will
+ * report the last tick through rtos_tick_hook, so that tick is not included
+ * in the returned number of elapsed ticks.
+ *
+ * Parameters:
+ *  max_ticks - Maximum number of ticks to sleep, 0 meaning no limit.
+ */
+rtos_u32 arch_tickless_sleep(rtos_u32 max_ticks)
+{
+   unsigned long remaining_cycles = 0;
+   unsigned long sleep_cycles = 0;
+   unsigned long elapsed_cycles = 0;
+   unsigned long next_cycles = 0;
+   unsigned long csr = 0;
+   rtos_u32 elapsed_ticks = 0;
+
+   if (max_ticks == 0 || max_ticks > MAX_SLEEP_TICKS)
+   {
+      max_ticks = MAX_SLEEP_TICKS;
+   }
+   if (max_ticks < 2)
+   {
+      /* Nothing to gain, sleep until the next periodic tick. */
+      WAIT_FOR_INTERRUPT;
+      return 0;
+   }
+
+   /* Stop SysTick and find out how much is left of the current period. If
+      the period just ended, the tick is pending and must be handled before
+      the timer wheel is looked at again. */
+   *SYST_CSR &= ~SYST_CSR_ENABLE;
+   remaining_cycles = *SYST_CVR;
+   if ((*SCB_ICSR & ICSR_PENDSTSET) != 0 || remaining_cycles == 0)
+   {
+      *SYST_CSR |= SYST_CSR_ENABLE;
+      return 0;
+   }
+
+   sleep_cycles = remaining_cycles + (max_ticks - 1) * RTOS_TICK_CYCLES;
+   *SYST_RVR = sleep_cycles - 1;
+   *SYST_CVR = 0;
+   *SYST_CSR |= SYST_CSR_ENABLE;
+
+   WAIT_FOR_INTERRUPT;
+
+   /* Reading CSR clears COUNTFLAG. */
+   csr = *SYST_CSR;
+   *SYST_CSR = csr & ~SYST_CSR_ENABLE;
+
+   if ((csr & SYST_CSR_COUNTFLAG) != 0)
+   {
+      /* The one-shot timer expired. The counter has been reloaded with
+         'sleep_cycles' - 1 and kept counting since then. */
+      elapsed_ticks = max_ticks - 1;
+      elapsed_cycles = (sleep_cycles - 1) - *SYST_CVR;
+      next_cycles = RTOS_TICK_CYCLES - (elapsed_cycles % RTOS_TICK_CYCLES);
+   }
+   else
+   {
+      /* Woken by some other interrupt. Count the whole tick periods that
+         elapsed. */
+      elapsed_cycles = sleep_cycles - *SYST_CVR;
+      if (elapsed_cycles < remaining_cycles)
+      {
+         next_cycles = remaining_cycles - elapsed_cycles;
+      }
+      else
+      {
+         elapsed_cycles -= remaining_cycles;
+         elapsed_ticks = 1 + elapsed_cycles / RTOS_TICK_CYCLES;
+         next_cycles = RTOS_TICK_CYCLES - (elapsed_cycles % RTOS_TICK_CYCLES);
+      }
+   }
+
+   /* Restart with the rest of the current period. The normal reload value
+      takes effect from the next period. */
+   *SYST_RVR = next_cycles - 1;
+   *SYST_CVR = 0;
+   *SYST_CSR |= SYST_CSR_ENABLE;
+   *SYST_RVR = RTOS_TICK_CYCLES - 1;
+
+   return elapsed_ticks;
+}
+#endif
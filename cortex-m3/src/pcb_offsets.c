@@ -0,0 +1,25 @@
+/*****************************************************************************
+ * pcb_offsets.c - Offsets of the PCB fields that the assembly parts of the
+ * kernel use.
+ *
+ * Not part of the kernel library. The Makefile compiles this file to
+ * assembly, where each OFFSET below leaves a line "->NAME offset", and turns
+ * those lines into the defines of pcb_offsets.h, which exceptions.S and
+ * kernel_arch_asm.S include. The offsets thus follow the PCB in pcb.h as it
+ * is laid out with the kernel configuration.
+ *
+ *****************************************************************************/
+
+#include <stddef.h>
+
+#include "pcb.h"
+
+#define OFFSET(name, member) \
+   asm volatile("\n->" #name " %0" :: "i" (offsetof(PCB, member)))
+
+void pcb_offsets(void)
+{
+   OFFSET(PCB_SP, sp);
+   OFFSET(PCB_ENTRY, entry);
+   OFFSET(PCB_THREAD_STACK_TOP, thread_stack_top);
+}
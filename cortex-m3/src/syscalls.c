@@ -1,4 +1,5 @@
 #include "rtos_types.h"
+#include "kernel.h"
 
 #define STRINGIFY(x) #x
 
@@ -46,6 +47,17 @@
       "svc\t0\n\t"::);		\
    }
 
+#define rtos_syscall_2_ret(CALL_ID, RET_TYPE, NAME, TYPE0, NAME0, TYPE1, NAME1) \
+  RET_TYPE NAME(TYPE0 NAME0, TYPE1 NAME1)                               \
+  {                                                                     \
+    rtos_u32 ret;                                                       \
+    asm ("mov r12, "STRINGIFY(CALL_ID)"\n\t"                            \
+         "svc\t0\n\t"                                                   \
+         "mov\t%[result], r0\n\t"                                       \
+         : [result]"=r" (ret));                                         \
+    return ret;                                                         \
+  }
+
 #define rtos_syscall_3(CALL_ID, RET_TYPE, NAME, TYPE0, NAME0, TYPE1, NAME1, TYPE2, NAME2) \
    RET_TYPE NAME(TYPE0 NAME0, TYPE1 NAME1, TYPE2 NAME2)				\
    { \
@@ -53,6 +65,17 @@
       "svc\t0\n\t"::);		\
    }
 
+#define rtos_syscall_3_ret(CALL_ID, RET_TYPE, NAME, TYPE0, NAME0, TYPE1, NAME1, TYPE2, NAME2) \
+  RET_TYPE NAME(TYPE0 NAME0, TYPE1 NAME1, TYPE2 NAME2)                  \
+  {                                                                     \
+    rtos_u32 ret;                                                       \
+    asm ("mov r12, "STRINGIFY(CALL_ID)"\n\t"                            \
+         "svc\t0\n\t"                                                   \
+         "mov\t%[result], r0\n\t"                                       \
+         : [result]"=r" (ret));                                         \
+    return ret;                                                         \
+  }
+
 rtos_syscall_0    (0, void,         rtos_yield);
 rtos_syscall_1_ret(1, rtos_address, rtos_alloc, rtos_u32, nbr_bytes);
 rtos_syscall_3    (2, void,         rtos_send,  rtos_address, buffer_address, rtos_u32, dest_pid, rtos_u32, dest_inbox);
@@ -63,3 +86,24 @@ rtos_syscall_1    (6, void,         rtos_delay, rtos_u32, nbr_ticks);
 rtos_syscall_0    (7, void,         rtos_wait_psem);
 rtos_syscall_1    (8, void,         rtos_signal_psem, rtos_u32, pid);
 rtos_syscall_0_ret(9, rtos_u32,     rtos_current_pid);
+rtos_syscall_2_ret(10, rtos_address, rtos_receive_any, rtos_u32, inbox_mask, rtos_u32 *, inbox);
+rtos_syscall_1_ret(11, rtos_u32,     rtos_inbox_count, rtos_u32, inbox);
+rtos_syscall_3    (12, void,        rtos_send_multicast, rtos_address, buffer_address, const rtos_destination *, destinations, rtos_u32, nbr_destinations);
+rtos_syscall_2_ret(13, rtos_u32,     rtos_critical_stats, rtos_u32, site, rtos_critical_site_stats *, stats);
+rtos_syscall_1    (14, void,        rtos_mutex_lock, rtos_u32, mutex);
+rtos_syscall_1    (15, void,        rtos_mutex_unlock, rtos_u32, mutex);
+rtos_syscall_3_ret(16, rtos_u32,     rtos_event_wait, rtos_u32, group, rtos_u32, mask, rtos_u32, options);
+rtos_syscall_2    (17, void,        rtos_event_set, rtos_u32, group, rtos_u32, flags);
+rtos_syscall_2_ret(18, rtos_u32,     rtos_event_clear, rtos_u32, group, rtos_u32, flags);
+rtos_syscall_2_ret(19, rtos_address, rtos_receive_timeout, rtos_u32, inbox, rtos_u32, nbr_ticks);
+rtos_syscall_3_ret(20, rtos_address, rtos_receive_any_timeout, rtos_u32, inbox_mask, rtos_u32 *, inbox, rtos_u32, nbr_ticks);
+rtos_syscall_1_ret(21, rtos_u32,     rtos_wait_psem_timeout, rtos_u32, nbr_ticks);
+rtos_syscall_2_ret(22, rtos_u32,     rtos_process_stats, rtos_u32, pid, rtos_process_usage *, usage);
+rtos_syscall_2_ret(23, rtos_address, rtos_alloc_priority, rtos_u32, nbr_bytes, rtos_u32, priority);
+rtos_syscall_2    (24, void,         rtos_set_message_priority, rtos_address, buffer_address, rtos_u32, priority);
+rtos_syscall_1    (25, void,         rtos_migrate, rtos_u32, core);
+rtos_syscall_0_ret(26, rtos_u32,     rtos_current_core);
+rtos_syscall_3    (27, void,         rtos_send_batch, const rtos_address *, buffers, rtos_u32, nbr_buffers, const rtos_destination *, destination);
+rtos_syscall_3_ret(28, rtos_u32,     rtos_receive_all, rtos_u32, inbox, rtos_address *, buffers, rtos_u32, max_buffers);
+rtos_syscall_2_ret(29, rtos_u32,     rtos_pool_stats, rtos_u32, pool, rtos_pool_usage *, usage);
+rtos_syscall_1_ret(30, rtos_u32,     rtos_buffers_held, rtos_u32, pid);
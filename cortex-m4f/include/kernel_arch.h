@@ -0,0 +1,10 @@
+/*****************************************************************************
+ * kernel_arch.h - Macros to be called from the kernel
+ * (portable or arch specific).
+ *
+ * The Cortex-M4F uses the same interrupt masking, sleep, trace time stamp and
+ * CLZ macros as the Cortex-M3.
+ *
+ *****************************************************************************/
+
+#include "../../cortex-m3/include/kernel_arch.h"
@@ -2,6 +2,14 @@
 #define KERNEL_H
 
 #include "rtos_types.h"
+#include "rtos_critical.h"
+
+/* A destination of a multicast message. */
+typedef struct
+{
+   rtos_u32 pid;
+   rtos_u32 inbox;
+} rtos_destination;
 
 /* Syscalls for applications. */
 
@@ -15,6 +23,188 @@ void rtos_delay(rtos_u32 nbr_ticks);
 void rtos_wait_psem();
 void rtos_signal_psem(rtos_u32 pid);
 rtos_u32 rtos_current_pid();
+rtos_address rtos_receive_any(rtos_u32 inbox_mask, rtos_u32 *inbox);
+rtos_u32 rtos_inbox_count(rtos_u32 inbox);
+
+/* Timed variants of rtos_receive, rtos_receive_any and rtos_wait_psem. The
+   receive calls return 0, and rtos_wait_psem_timeout returns 0 instead of 1,
+   if nothing arrived within 'nbr_ticks' ticks. A timeout of 0 only checks,
+   without waiting, and RTOS_WAIT_FOREVER waits without timeout. */
+#define RTOS_WAIT_FOREVER 0xFFFFFFFFu
+
+rtos_address rtos_receive_timeout(rtos_u32 inbox, rtos_u32 nbr_ticks);
+rtos_address rtos_receive_any_timeout(rtos_u32 inbox_mask, rtos_u32 *inbox,
+                                      rtos_u32 nbr_ticks);
+rtos_u32 rtos_wait_psem_timeout(rtos_u32 nbr_ticks);
+
+/* Message priorities. An inbox delivers the messages with the highest
+   priority first, and messages with the same priority in the order they
+   were sent. Priorities run from 0, which rtos_alloc gives, to
+   MESSAGE_PRIORITIES - 1 in config.mk. Larger values are taken as the
+   highest priority. rtos_alloc_priority allocates a buffer like rtos_alloc
+   with the given priority, and rtos_set_message_priority changes the
+   priority of an allocated or received buffer before it is sent. It may
+   not be called while the buffer is on its way, from the send until it is
+   received, nor for a buffer that has been multicast, as the inboxes are
+   ordered by the priority. The priority stays with the buffer when it is
+   received and sent on. */
+rtos_address rtos_alloc_priority(rtos_u32 nbr_bytes, rtos_u32 priority);
+void rtos_set_message_priority(rtos_address buffer_address,
+                               rtos_u32 priority);
+
+/* Sends the buffer to all 'nbr_destinations' destinations without copying
+   it. Each receiver gets a reference to the same buffer, which must be
+   treated as read-only, and disposes it as usual. The buffer is freed when
+   the last reference is disposed. A buffer in several inboxes at once takes
+   an inbox node from the kernel pool for each of them but one. If the
+   kernel pool is used up, the message is not delivered to a destination
+   that needs a node, and its reference is disposed instead. */
+void rtos_send_multicast(rtos_address buffer_address,
+                         const rtos_destination *destinations,
+                         rtos_u32 nbr_destinations);
+
+/* Batched messages, passed with one syscall per batch instead of one per
+   message. rtos_send_batch sends the 'nbr_buffers' buffers in 'buffers' to
+   one destination, as rtos_send would send them one after another.
+   rtos_receive_all takes the messages of an inbox, or the first
+   'max_buffers' of them, in the order rtos_receive would return them,
+   stores them in 'buffers' and returns their number. If the inbox is
+   empty, it waits like rtos_receive and returns 1 with the message that
+   arrives. */
+void rtos_send_batch(const rtos_address *buffers, rtos_u32 nbr_buffers,
+                     const rtos_destination *destination);
+rtos_u32 rtos_receive_all(rtos_u32 inbox, rtos_address *buffers,
+                          rtos_u32 max_buffers);
+
+/* Locks a mutex created with rtos_create_mutex, waiting until it is
+   unlocked if another process owns it. While waiting, the owner inherits
+   the priority of the caller if that is higher. A mutex is not recursive. */
+void rtos_mutex_lock(rtos_u32 mutex);
+
+/* Unlocks a mutex owned by the caller. The mutex is handed over directly to
+   the highest-priority waiting process, if any, and the caller drops the
+   priority it inherited through the mutex. */
+void rtos_mutex_unlock(rtos_u32 mutex);
+
+/* Options of rtos_event_wait. */
+#define RTOS_EVENT_WAIT_ANY 0x0 /* Wait for any of the bits in the mask. */
+#define RTOS_EVENT_WAIT_ALL 0x1 /* Wait for all the bits in the mask. */
+#define RTOS_EVENT_CLEAR    0x2 /* Clear the bits in the mask on return. */
+
+/* Waits until the flags of an event group created with
+   rtos_create_event_group satisfy 'mask', which must not be 0, as given by
+   'options'. Returns the flags as they were when the wait was satisfied,
+   before any clearing. */
+rtos_u32 rtos_event_wait(rtos_u32 group, rtos_u32 mask, rtos_u32 options);
+
+/* Sets flags of an event group and wakes all the waiters that are then
+   satisfied. The bits to clear for those waiters are cleared when all
+   waiters have been checked, so every waiter sees the flags set here. */
+void rtos_event_set(rtos_u32 group, rtos_u32 flags);
+
+/* Clears flags of an event group. Returns the flags before clearing. */
+rtos_u32 rtos_event_clear(rtos_u32 group, rtos_u32 flags);
+
+/* Copies the interrupt masking statistics of a critical-section site, see
+   rtos_critical.h, to 'stats'. Returns 0 if there is no such site or if the
+   profiler is not configured. */
+rtos_u32 rtos_critical_stats(rtos_u32 site, rtos_critical_site_stats *stats);
+
+/* CPU time and stack usage of a process, kept with PROCESS_STATS in
+   config.mk. Times are in units of the trace time stamp counter, as for
+   rtos_critical_stats. Interrupt handlers are accounted to the process
+   they interrupt. */
+typedef struct
+{
+   rtos_u64 run_cycles;    /* Total time the process has run. */
+   rtos_u32 switch_count;  /* Number of times it has been switched in. */
+   rtos_u32 stack_size;    /* Stack size in bytes. */
+   rtos_u32 stack_used;    /* Deepest stack use so far, in bytes. */
+} rtos_process_usage;
+
+/* Copies the statistics of process 'pid' to 'usage'. The stack high-water
+   mark is found by scanning the unused part of the stack, which was painted
+   when the process was created, with interrupts disabled. Returns 0 if
+   there is no such process or if the statistics are not configured. */
+rtos_u32 rtos_process_stats(rtos_u32 pid, rtos_process_usage *usage);
+
+/* Usage of a buffer pool, kept with BUFFER_STATS in config.mk. A pool
+   grows by one buffer each time an allocation finds it without free
+   buffers, taking the memory from the kernel pool, which all pools and the
+   kernel's inbox nodes share, and it never shrinks. */
+typedef struct
+{
+   rtos_u32 buffer_size;       /* Size of the buffers in bytes. */
+   rtos_u32 nbr_buffers;       /* Buffers in the pool, free or in use. */
+   rtos_u32 nbr_free;          /* Buffers not in use. */
+   rtos_u32 peak_used;         /* Most buffers in use at once. */
+   rtos_u32 alloc_failures;    /* Allocations that found no memory. */
+   rtos_u32 kernel_pool_left;  /* Bytes left in the kernel pool. */
+} rtos_pool_usage;
+
+/* Copies the usage of buffer pool 'pool', the index of its size in
+   BUFFER_SIZES, to 'usage'. Returns 0 if there is no such pool or if the
+   statistics are not configured. */
+rtos_u32 rtos_pool_stats(rtos_u32 pool, rtos_pool_usage *usage);
+
+/* Returns the number of buffers that process 'pid' holds, with
+   BUFFER_STATS: those it has allocated or received, and not yet sent or
+   disposed. A multicast buffer counts once for each receiver until it
+   disposes it, and a buffer in an inbox counts for nobody. Buffers that
+   interrupt handlers allocate, send or dispose are not counted for any
+   process. The counts are thus only right if a buffer that a process gets
+   from the kernel is sent or disposed by a process, and a buffer that an
+   interrupt handler allocates is sent or disposed by an interrupt handler.
+   The pid of the process that allocated or received a buffer last is kept
+   in the buffer header, where a debugger finds it. Returns 0 if there is
+   no such process or if the statistics are not configured. */
+rtos_u32 rtos_buffers_held(rtos_u32 pid);
+
+/* Cores, with NBR_CORES in config.mk. Every process runs on one core, and
+   each core schedules its own processes by priority. rtos_migrate moves
+   the calling process to another core, where it continues when that core
+   schedules it. rtos_current_core returns the core of the caller. */
+void rtos_migrate(rtos_u32 core);
+rtos_u32 rtos_current_core(void);
+
+/* Configuration calls, only to be called from rtos_hook_create_processes.
+   rtos_create_process creates a process on core 0, and
+   rtos_create_process_on_core on the given core. rtos_create_mutex returns
+   the id of a new, unlocked mutex, and rtos_create_event_group the id of a
+   new event group with all flags cleared. */
+rtos_u32 rtos_create_process(rtos_address entry, rtos_u16 stack_size,
+                             rtos_u8 priority);
+rtos_u32 rtos_create_process_on_core(rtos_address entry, rtos_u16 stack_size,
+                                     rtos_u8 priority, rtos_u32 core);
+rtos_u32 rtos_create_mutex(void);
+rtos_u32 rtos_create_event_group(void);
+
+/* Calls for interrupt handlers that are disabled by the kernel's critical
+   sections, i.e. that may use the kernel API. They enter the kernel without
+   a syscall trap. A context switch that they cause takes place when the
+   interrupt handlers have finished. Not to be called from processes. */
+void rtos_send_from_isr(rtos_address buffer_address, rtos_u32 dest_pid,
+                        rtos_u32 dest_inbox);
+void rtos_signal_psem_from_isr(rtos_u32 pid);
+void rtos_tick_from_isr(void);
+rtos_address rtos_alloc_from_isr(rtos_u32 nbr_bytes);
+void rtos_dispose_from_isr(rtos_address buffer_address);
+void rtos_event_set_from_isr(rtos_u32 group, rtos_u32 flags);
+
+/* Deferred work, with WORK_QUEUES in config.mk. An interrupt handler posts
+   a call of 'function' with 'arg' to one of the work queues, and a kernel
+   process at WORK_PRIORITY makes the calls, in the order they were posted
+   to each queue. Each queue must be posted to by one interrupt handler
+   only. As posting neither masks interrupts nor takes a lock, any
+   interrupt handler may post, also those that the kernel's critical
+   sections do not disable. The functions run in the work process and may
+   use the kernel calls of a process, but should not wait long, as they
+   delay the work behind them. Returns 0 if the queue is full, otherwise
+   1. */
+typedef void (*rtos_work_function)(rtos_address arg);
+
+rtos_u32 rtos_defer_from_isr(rtos_u32 queue, rtos_work_function function,
+                             rtos_address arg);
 
 #endif
 
@@ -3,6 +3,64 @@
 
 #include "rtos_types.h"
 #include "pcb.h"
+#include "rtos_critical.h"
+
+#if RTOS_NBR_CORES > 1
+/* The running process and the process to switch to of each core. The arch
+   code uses current_pcb and new_pcb, which are those of the core it runs
+   on, as with a single core. */
+extern PCB *rtos_current_pcbs[RTOS_NBR_CORES];
+extern PCB *rtos_new_pcbs[RTOS_NBR_CORES];
+
+#define current_pcb (rtos_current_pcbs[ARCH_CORE_ID()])
+#define new_pcb (rtos_new_pcbs[ARCH_CORE_ID()])
+
+/******************************************************************************
+ * Function: rtos_kernel_lock, rtos_kernel_unlock
+ *
+ * Take and release the kernel spinlock. The arch code holds it around
+ * rtos_reschedule_hook and keeps it until the context switch is complete,
+ * so that no other core switches in the process switched out before its
+ * context has been saved. The switched-in process releases it, also when
+ * it starts for the first time. arch_start and the start of the other
+ * cores take it before the first process of the core is started.
+ */
+extern void rtos_kernel_lock(void);
+extern void rtos_kernel_unlock(void);
+
+/******************************************************************************
+ * Function: arch_kick_core
+ *
+ * Interrupt core 'core', which is not the calling core, to have it
+ * reschedule, like arch_trigger_pendsv on that core.
+ */
+extern void arch_kick_core(rtos_u32 core);
+#endif
+
+/******************************************************************************
+ * Function: arch_start
+ *
+ * Start executing the process described by 'pcb'. Never returns. With
+ * several cores, the other cores are started too, each with its process in
+ * rtos_current_pcbs.
+ */
+extern void arch_start(PCB *pcb);
+
+/******************************************************************************
+ * Function: arch_trigger_pendsv
+ *
+ * Schedule a context switch to take place when leaving the kernel, on the
+ * calling core.
+ */
+extern void arch_trigger_pendsv(void);
+
+/******************************************************************************
+ * Function: arch_store_retval
+ *
+ * Set the value that the process described by 'pcb', which is not the
+ * running process, returns from its current syscall with.
+ */
+extern void arch_store_retval(rtos_address retval, PCB *pcb);
 
 /******************************************************************************
  * Function: arch_init_stack
@@ -11,4 +69,47 @@
  */
 extern void arch_init_stack(PCB *pcb);
 
+/******************************************************************************
+ * Function: arch_tickless_sleep
+ *
+ * Only used with tickless idle. Called from the idle process, with all
+ * interrupts masked, to stop the periodic tick and sleep for at most
+ * 'max_ticks' ticks (0 meaning as long as possible), or until an interrupt
+ * becomes pending. The periodic tick is then restarted. Returns the number
+ * of tick periods that elapsed during the sleep and that will not be
+ * reported through rtos_tick_hook.
+ */
+extern rtos_u32 arch_tickless_sleep(rtos_u32 max_ticks);
+
+/******************************************************************************
+ * Function: rtos_tick_hook
+ *
+ * Called from the arch-specific tick interrupt handler, when the kernel owns
+ * the tick timer, to advance the tick counter one tick.
+ */
+extern void rtos_tick_hook(void);
+
+#ifdef RTOS_CRITICAL_PROFILE
+/******************************************************************************
+ * Function: rtos_critical_profile_start
+ *
+ * Called by the arch-specific code right after it has disabled interrupts
+ * on kernel entry.
+ */
+extern void rtos_critical_profile_start(void);
+
+/******************************************************************************
+ * Function: rtos_critical_profile_stop
+ *
+ * Called by the arch-specific code right before it restores the interrupt
+ * mask on kernel exit. 'site' is one of RTOS_CRITICAL_SITE_*, or
+ * RTOS_CRITICAL_SITE_SYSCALL plus the syscall id.
+ */
+extern void rtos_critical_profile_stop(rtos_u32 site);
+#endif
+
+/* Hooks provided by the application/BSP. */
+extern void rtos_hook_create_processes(void);
+extern void soc_start_hook(void);
+
 #endif
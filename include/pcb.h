@@ -0,0 +1,197 @@
+#ifndef PCB_H
+#define PCB_H
+
+#include "rtos_types.h"
+
+/* Number of inboxes of each process, configured from config.mk. An inbox
+   mask has one bit per inbox, so there can be at most 32. */
+#ifndef RTOS_NBR_INBOXES
+#define RTOS_NBR_INBOXES 4
+#endif
+
+#if RTOS_NBR_INBOXES < 1 || RTOS_NBR_INBOXES > 32
+#error "RTOS_NBR_INBOXES must be in the range 1-32"
+#endif
+
+#define PCB_NBR_INBOXES RTOS_NBR_INBOXES
+
+/* Number of message priorities, configured from config.mk. */
+#ifndef RTOS_MESSAGE_PRIORITIES
+#define RTOS_MESSAGE_PRIORITIES 4
+#endif
+
+/* Number of cores, configured from config.mk. */
+#ifndef RTOS_NBR_CORES
+#define RTOS_NBR_CORES 1
+#endif
+
+typedef enum
+{
+   PROCESS_STATE_RUNNING,
+   PROCESS_STATE_READY,
+   PROCESS_STATE_RECEIVE,
+   PROCESS_STATE_DELAY,
+   PROCESS_STATE_PSEM,
+   PROCESS_STATE_MUTEX,
+   PROCESS_STATE_EVENT
+} ProcessState;
+
+/* The fields that the scheduler and the context switch use on every switch
+   come first, so that they are in the same cache line and within reach of
+   short load offsets, and the small fields are packed into words. The
+   assembly parts of the kernel get the offsets that they use from
+   pcb_offsets.h, which the architecture's Makefile generates from this
+   struct, so the fields may be moved. */
+typedef struct PCB
+{
+      rtos_address        sp;
+      struct PCB          *next;
+
+      /* 'priority' is the priority that the process is scheduled with. It
+	 is raised above the assigned 'base_priority' by priority
+	 inheritance while the process holds a mutex that a higher-priority
+	 process waits for. 'process_state' is a ProcessState, and 'core'
+	 the core that the process runs on. */
+      rtos_u8             priority;
+      rtos_u8             process_state;
+      rtos_u8             core;
+      rtos_u8             base_priority;
+      rtos_u16            pid;
+
+      /* 'event_options' tells how the process waits for 'event_mask' while
+	 in PROCESS_STATE_EVENT, as given to rtos_event_wait. */
+      rtos_u8             event_options;
+
+      /* 'delay_until' is the tick time when the process should
+	 be put in the readylist again. While the process is in the
+	 delaylist, in PROCESS_STATE_DELAY or in a timed wait, 'delay_link'
+	 points at the pointer that links it there, so that it can be taken
+	 out in constant time. Otherwise it is 0. */
+      rtos_u32            delay_until;
+      struct PCB          **delay_link;
+
+      /* 'psem_value' is the value of the process specific semaphore. */
+      rtos_u32            psem_value;
+
+      /* 'receive_mask' has one bit set for each inbox the process waits for
+	 a message in while in PROCESS_STATE_RECEIVE. The inbox the message
+	 was taken from is stored in 'receive_inbox', unless it is 0. In
+	 rtos_receive_all, the message is stored in 'receive_buffer' and the
+	 call returns 1, otherwise 'receive_buffer' is 0. */
+      rtos_u32            receive_mask;
+      rtos_u32            *receive_inbox;
+      rtos_address        *receive_buffer;
+
+#if RTOS_NBR_CORES > 1
+      /* Spinlock of the inboxes, and of the entry into and the exit from
+	 PROCESS_STATE_RECEIVE. */
+      volatile rtos_u32   inbox_lock;
+#endif
+
+      /* Each inbox is a list of messages, the most urgent first and FIFO
+	 within a message priority. 'inbox_tail' holds the last message of
+	 each priority in the inbox, and 'inbox_priorities' has bit 'p' set
+	 if there is a message of priority 'p'. */
+      struct MessageRef   *inbox[PCB_NBR_INBOXES];
+      struct MessageRef   *inbox_tail[PCB_NBR_INBOXES][RTOS_MESSAGE_PRIORITIES];
+      rtos_u16            inbox_count[PCB_NBR_INBOXES];
+      rtos_u8             inbox_priorities[PCB_NBR_INBOXES];
+
+      /* 'mutex_wait' is the mutex that the process waits for while in
+	 PROCESS_STATE_MUTEX. 'mutexes_held' is the list of mutexes that the
+	 process owns. */
+      struct Mutex        *mutex_wait;
+      struct Mutex        *mutexes_held;
+      rtos_u32            event_mask;
+
+      /* Set up when the process is created. The entry point is used by
+	 arch_init_stack, and the stack of 'stack_size' bytes ends at
+	 'thread_stack_top'. */
+      rtos_address        entry;
+      rtos_address        thread_stack_top;
+      rtos_u16            stack_size;
+
+#ifdef RTOS_PROCESS_STATS
+      /* 'run_cycles' is the time the process has run, up to its latest
+	 switch-out, and 'switch_count' the number of switch-ins. */
+      rtos_u64            run_cycles;
+      rtos_u32            switch_count;
+#endif
+
+#ifdef RTOS_BUFFER_STATS
+      /* Number of references to buffers in use that the process holds,
+	 i.e. that it has allocated or received, and not yet sent or
+	 disposed. Only changed by the process itself, and by a process that
+	 sends it a message while it waits in a receive call. */
+      rtos_u32            buffers_held;
+#endif
+} PCB;
+
+/* The kernel objects that PCBs refer to. They are defined here, rather than
+   in the kernel, so that the static configuration, see rtos_static.h, can
+   allocate them. */
+
+/* A node in an inbox, referring to a message buffer. Every buffer has one
+   node of its own, used for the first inbox that it is put in. A buffer that
+   is multicast to several inboxes at once needs extra nodes, which are taken
+   from a pool of free nodes. */
+typedef struct MessageRef
+{
+      struct MessageRef   *next;
+      struct BufferHeader *buffer;
+} MessageRef;
+
+typedef struct BufferHeader
+{
+      rtos_u32            magic;
+      struct BufferHeader *next;
+      MessageRef          ref;
+
+      /* Number of processes holding or about to receive the buffer. The
+         buffer is freed when the last of them disposes it. */
+      rtos_u16            refcount;
+
+      /* Non-zero while 'ref' is in an inbox. */
+      rtos_u8             ref_used;
+      rtos_u8             pool;
+
+      /* Message priority, 0 unless set with rtos_alloc_priority or
+	 rtos_set_message_priority. */
+      rtos_u8             priority;
+
+#ifdef RTOS_BUFFER_STATS
+      /* Pid of the process that allocated the buffer or received it last,
+	 while the buffer is in use, for a debugger. The references are
+	 counted in the PCBs of the processes that hold them. */
+      rtos_u16            owner;
+#endif
+} BufferHeader;
+
+typedef struct BufferTrailer
+{
+      rtos_u32            magic;
+} BufferTrailer;
+
+/* An event group. 'waiters' holds the processes waiting for its flags,
+   linked through 'next', in the order they started waiting. 'next' links
+   the event groups in creation order until the kernel is started. */
+typedef struct EventGroup
+{
+      rtos_u32            flags;
+      PCB                 *waiters;
+      PCB                 *waiters_tail;
+      struct EventGroup   *next;
+} EventGroup;
+
+/* A mutex. 'waiters' holds the processes waiting for the mutex, linked
+   through 'next', in priority order and FIFO within a priority. The mutexes
+   owned by a process are linked through 'next_held', which also links the
+   mutexes in creation order until the kernel is started. */
+typedef struct Mutex
+{
+      PCB                 *owner;
+      PCB                 *waiters;
+      struct Mutex        *next_held;
+} Mutex;
+
+#endif
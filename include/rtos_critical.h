@@ -0,0 +1,41 @@
+#ifndef RTOS_CRITICAL_H
+#define RTOS_CRITICAL_H
+
+/* The interrupt masking profiler, enabled with CRITICAL_PROFILE in
+   config.mk.
+
+   For every critical-section site, i.e. every place where the kernel masks
+   the interrupts that may use the kernel API, the kernel counts the number
+   of times it was entered and records the longest and the total time spent
+   masked. Times are in units of the trace time stamp counter, core clock
+   cycles on Cortex-M and nanoseconds on posix. A nested critical section is
+   counted as part of the outermost one. The statistics are read with
+   rtos_critical_stats. This file is also included from assembly. */
+
+/* Sites. The syscall handlers are sites RTOS_CRITICAL_SITE_SYSCALL +
+   syscall id. */
+#define RTOS_CRITICAL_SITE_RESCHEDULE         0 /* Context switch. */
+#define RTOS_CRITICAL_SITE_TICK               1 /* Tick interrupt. */
+#define RTOS_CRITICAL_SITE_SEND_FROM_ISR      2
+#define RTOS_CRITICAL_SITE_SIGNAL_PSEM_FROM_ISR 3
+#define RTOS_CRITICAL_SITE_ALLOC_FROM_ISR     4
+#define RTOS_CRITICAL_SITE_DISPOSE_FROM_ISR   5
+#define RTOS_CRITICAL_SITE_IDLE               6 /* Excluding the sleep. */
+#define RTOS_CRITICAL_SITE_AUDIT              7 /* CHECK_LEVEL 2. */
+#define RTOS_CRITICAL_SITE_EVENT_SET_FROM_ISR 8
+#define RTOS_CRITICAL_SITE_SYSCALL            9
+
+#ifndef __ASSEMBLER__
+
+#include "rtos_types.h"
+
+typedef struct
+{
+   rtos_u32 count;
+   rtos_u32 max_cycles;
+   rtos_u64 total_cycles;
+} rtos_critical_site_stats;
+
+#endif
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef RTOS_STATIC_H
+#define RTOS_STATIC_H
+
+#include "rtos_types.h"
+#include "pcb.h"
+
+/* The static kernel configuration, used with STATIC_CONFIG in config.mk.
+
+   Instead of creating the processes, mutexes and event groups at boot, in
+   rtos_hook_create_processes, the kernel takes them from the tables below.
+   They are generated by tools/conf_gen.py from a description of the
+   application, see the tool, and compiled into the application. The PCBs,
+   stacks, kernel objects and preallocated buffers are then ordinary .bss
+   arrays, and the tables that point at them are in .rodata, so the linker
+   sizes and checks all of that memory. The generated file must be compiled
+   with RTOS_CONFIG_CFLAGS, as the layout of the PCB depends on them. */
+
+/* A process. Its pid is its index in the tables. The last processes are
+   the idle processes of the cores, one per core, and with WORK_QUEUES the
+   work process comes just before them. Their 'entry' is 0 as the kernel
+   supplies it. */
+typedef struct
+{
+   rtos_address entry;
+   rtos_address stack;       /* Lowest address, 8-byte aligned. */
+   rtos_u16     stack_size;
+   rtos_u8      priority;
+   rtos_u8      core;
+} RtosStaticProcess;
+
+/* The preallocated buffers of a buffer pool, one per size in BUFFER_SIZES,
+   in that order. Each buffer takes RTOS_STATIC_BUFFER_BYTES(buffer_size)
+   bytes of 'memory'. */
+typedef struct
+{
+   rtos_u32     buffer_size;
+   rtos_u32     nbr_buffers;
+   rtos_address memory;
+} RtosStaticPool;
+
+/* Bytes taken by a buffer of 'size' bytes, including the kernel's header
+   and trailer, rounded up to keep the next header aligned. */
+#define RTOS_STATIC_BUFFER_BYTES(size)                                  \
+   ((sizeof(BufferHeader) + (size) + sizeof(BufferTrailer) +           \
+     sizeof(rtos_address) - 1) & ~(sizeof(rtos_address) - 1))
+
+extern const rtos_u32 rtos_static_nbr_processes;
+extern const RtosStaticProcess rtos_static_processes[];
+extern PCB *const rtos_static_pid_map[];
+
+extern const rtos_u32 rtos_static_nbr_mutexes;
+extern Mutex *const rtos_static_mutex_map[];
+
+extern const rtos_u32 rtos_static_nbr_event_groups;
+extern EventGroup *const rtos_static_event_group_map[];
+
+extern const rtos_u32 rtos_static_nbr_pools;
+extern const RtosStaticPool rtos_static_pools[];
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef RTOS_TRACE_H
+#define RTOS_TRACE_H
+
+#include "rtos_types.h"
+
+/* The kernel event trace, enabled with TRACE in config.mk.
+
+   The kernel writes one record per event to the ring buffer in the global
+   'rtos_trace'. 'write_count' is the total number of records written, so
+   the newest record is records[(write_count - 1) % nbr_records]. To inspect
+   the trace, dump 'rtos_trace' (nbr_records records after the header) from
+   a debugger or from the application, and convert it with
+   tools/trace2chrome.py. All fields are in the byte order of the target. */
+
+#ifndef RTOS_TRACE_RECORDS
+#define RTOS_TRACE_RECORDS 256
+#endif
+
+#define RTOS_TRACE_MAGIC 0x52545452 /* "RTTR" */
+#define RTOS_TRACE_VERSION 1
+
+/* Events, with the meaning of the 'pid' and 'arg' fields. Args larger than
+   0xFFFF are saturated. A pid argument of 0xFFFF means no process. The
+   'pid' field holds the low 8 bits of the pid, or RTOS_TRACE_NO_PID for an
+   interrupt handler that allocates or disposes a buffer. */
+#define RTOS_TRACE_NO_PID 0xFF
+
+typedef enum
+{
+   RTOS_TRACE_SWITCH = 1,    /* pid: switched out, arg: switched in. */
+   RTOS_TRACE_SEND,          /* pid: sender, arg: dest pid | inbox << 8. */
+   RTOS_TRACE_RECEIVE,       /* pid: receiver, arg: inbox received from. */
+   RTOS_TRACE_RECEIVE_WAIT,  /* pid: receiver, arg: inbox mask. */
+   RTOS_TRACE_ALLOC,         /* pid: allocator or none, arg: size. */
+   RTOS_TRACE_DISPOSE,       /* pid: disposer or none, arg: buffer pool. */
+   RTOS_TRACE_DELAY,         /* pid: delayed process, arg: ticks. */
+   RTOS_TRACE_TICK_WAKEUP,   /* pid: woken process, arg: tick & 0xFFFF. */
+   RTOS_TRACE_PSEM_WAIT,     /* pid: waiter, arg: 1 if it blocks. */
+   RTOS_TRACE_PSEM_SIGNAL,   /* pid: signaled, arg: 1 if it was woken. */
+   RTOS_TRACE_MUTEX_LOCK,    /* pid: locker, arg: owner if it blocks. */
+   RTOS_TRACE_MUTEX_UNLOCK,  /* pid: unlocker, arg: new owner. */
+   RTOS_TRACE_PRIORITY,      /* pid: process, arg: new priority. */
+   RTOS_TRACE_EVENT_WAIT,    /* pid: waiter, arg: 1 if it blocks. */
+   RTOS_TRACE_EVENT_SET,     /* pid: setter, arg: number of woken. */
+   RTOS_TRACE_TIMEOUT        /* pid: timed out waiter, arg: its state. */
+} RtosTraceEvent;
+
+typedef struct RtosTraceRecord
+{
+      rtos_u32            timestamp;
+      rtos_u8             event;
+      rtos_u8             pid;
+      rtos_u16            arg;
+} RtosTraceRecord;
+
+typedef struct RtosTrace
+{
+      rtos_u32            magic;
+      rtos_u16            version;
+      rtos_u16            record_size;
+      rtos_u32            nbr_records;
+
+      /* Frequency of the time stamp counter. */
+      rtos_u32            timestamp_hz;
+      rtos_u32            write_count;
+      RtosTraceRecord     records[RTOS_TRACE_RECORDS];
+} RtosTrace;
+
+extern RtosTrace rtos_trace;
+
+#endif
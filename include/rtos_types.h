@@ -1,7 +1,10 @@
 #ifndef RTOS_TYPES_H
 #define RTOS_TYPES_H
 
-typedef unsigned int rtos_address;
+/* rtos_address must be able to hold a pointer, on 32-bit targets as well as
+   on 64-bit hosts. */
+typedef unsigned long rtos_address;
+typedef unsigned long long rtos_u64;
 typedef unsigned int rtos_u32;
 typedef unsigned short rtos_u16;
 typedef unsigned char rtos_u8;
@@ -6,10 +6,39 @@
  * board has been properly set up and memory regions such as BSS and DATA have
  * been initialized.
  *
+ * The kernel data is protected by disabling the interrupts that may use the
+ * kernel API (INTERRUPT_DISABLE_SAVE). The arch-specific code calls the
+ * syscall handlers and rtos_reschedule_hook with these interrupts disabled.
+ * Kernel entry points called from interrupt handlers, rtos_tick_hook and the
+ * *_from_isr functions, disable them themselves, in critical sections that
+ * nest. The internal functions below assume that they are disabled and do
+ * not touch the interrupt mask.
  *
- * TODO:
- * - Introduce DISABLE_SAVE/ENABLE_SAVED macros to handle nested critical
- *     regions.
+ * A process that is preempted stays in PROCESS_STATE_RUNNING until the
+ * context switch, where rtos_reschedule_hook puts it back in the readylist.
+ * That way, several interrupt handlers may schedule a context switch before
+ * it takes place, without the preempted process being queued twice.
+ *
+ * With several cores, RTOS_NBR_CORES, every process belongs to one core,
+ * 'core' in its PCB, and each core has its own current process and
+ * ready-queue. Disabling interrupts then only protects against the calling
+ * core, and the data shared between the cores is protected by spinlocks,
+ * taken in this order:
+ *
+ *  kernel_lock - The ready-queues, the timer wheel, the process states,
+ *                psems, mutexes and event groups.
+ *  inbox_lock  - In each PCB. Its inboxes, and the entry into RECEIVE,
+ *                so that a message is either put in an inbox or handed to
+ *                a receiver that waits for it. RECEIVE is left with the
+ *                kernel lock held.
+ *  alloc_lock  - The free-lists, the free inbox nodes, the reference counts
+ *                of the buffers and the kernel pool.
+ *
+ * Allocating, disposing, sending to a process that does not wait for the
+ * message and receiving a message that is already there thus take no
+ * kernel lock. A process made ready for another core, which should preempt
+ * the process running there, makes that core reschedule with
+ * arch_kick_core. With a single core, the locks are compiled out.
  *
  *****************************************************************************/
 
@@ -18,50 +47,261 @@
 #include "kernel_int.h" /* TODO, more prototypes in that file. */
 #include "kernel_arch.h"
 #include "pcb.h"
+#include "rtos_trace.h"
+#ifdef RTOS_STATIC_CONFIG
+#include "rtos_static.h"
+#endif
 
 /*****************************************************************************
  * Defines, Constants, Typedefs and Structs
  *****************************************************************************/
 
+/* Integrity check level, configured from config.mk:
+   0 - No checks.
+   1 - Cheap, constant-time invariant asserts in the kernel paths.
+   2 - As 1, plus an auditor that verifies all kernel lists and buffer
+       magics while the idle process runs. */
+#ifndef RTOS_CHECK_LEVEL
+#define RTOS_CHECK_LEVEL 1
+#endif
+
+#if RTOS_CHECK_LEVEL >= 1
 #define kernel_assert(expr) do { if (!(expr)) assertion_failed(); } while (0)
+#else
+#define kernel_assert(expr) do { } while (0)
+#endif
+
+/* Number of priority levels, 0 being the highest priority. Configured from
+   config.mk. The ready-queue bitmap has one bit per level, so there can be
+   at most 32 levels. The lowest level is used by the idle process only. */
+#ifndef RTOS_NBR_PRIORITIES
+#define RTOS_NBR_PRIORITIES 32
+#endif
+
+#if RTOS_NBR_PRIORITIES < 2 || RTOS_NBR_PRIORITIES > 32
+#error "RTOS_NBR_PRIORITIES must be in the range 2-32"
+#endif
+
+/* The lowest priority is reserved for the idle process. */
+#define IDLE_PRIORITY (RTOS_NBR_PRIORITIES - 1)
+
+/* Stack size of the idle process. Configured from config.mk. */
+#ifndef RTOS_IDLE_STACK_SIZE
+#define RTOS_IDLE_STACK_SIZE 256
+#endif
+
+#if RTOS_NBR_CORES < 1 || RTOS_NBR_CORES > 8
+#error "RTOS_NBR_CORES must be in the range 1-8"
+#endif
+
+/* Ticks that a process may run before the ready processes of its priority
+   get their turn, 0 for no time slicing. Configured from config.mk. */
+#ifndef RTOS_TIME_SLICE
+#define RTOS_TIME_SLICE 0
+#endif
+
+/* Deferred work queues, and the items per queue, priority and stack size
+   of the work process that runs them. Configured from config.mk. */
+#ifndef RTOS_WORK_QUEUES
+#define RTOS_WORK_QUEUES 0
+#endif
+
+#if RTOS_WORK_QUEUES > 0
+#if (RTOS_WORK_QUEUE_ITEMS & (RTOS_WORK_QUEUE_ITEMS - 1)) != 0
+#error "RTOS_WORK_QUEUE_ITEMS must be a power of 2"
+#endif
+#if RTOS_WORK_PRIORITY >= IDLE_PRIORITY
+#error "RTOS_WORK_PRIORITY must be higher than the idle priority"
+#endif
+#endif
+
+/* Spinlocks between the cores, see the top of this file. Interrupts must
+   be disabled while a lock is held. */
+#if RTOS_NBR_CORES > 1
+#define SPIN_LOCK(lock) ARCH_SPIN_LOCK(lock)
+#define SPIN_UNLOCK(lock) ARCH_SPIN_UNLOCK(lock)
+#else
+#define SPIN_LOCK(lock) do { } while (0)
+#define SPIN_UNLOCK(lock) do { } while (0)
+#endif
+
+#define KERNEL_LOCK() SPIN_LOCK(&kernel_lock)
+#define KERNEL_UNLOCK() SPIN_UNLOCK(&kernel_lock)
+
+/* Non-zero if the process waits for a message in 'inbox'. */
+#define RECEIVE_WAITING(pcb, inbox)                                    \
+   ((pcb)->process_state == PROCESS_STATE_RECEIVE &&                   \
+    ((pcb)->receive_mask & INBOX_BIT(inbox)) != 0)
+
+/* Bit representing 'priority' in the ready-queue bitmap. The highest
+   priority (0) is bit 31, so that the highest priority with a ready process
+   is given directly by a count-leading-zeros of the bitmap. */
+#define READY_BIT(priority) (0x80000000u >> (priority))
+
+/* The timer wheel holding delayed processes has TIMER_WHEEL_LEVELS levels of
+   TIMER_WHEEL_SLOTS slots each. Every level covers TIMER_WHEEL_BITS more
+   bits of the 32-bit tick counter than the level below. */
+#define TIMER_WHEEL_BITS 4
+#define TIMER_WHEEL_SLOTS (1u << TIMER_WHEEL_BITS)
+#define TIMER_WHEEL_LEVELS ((32 + TIMER_WHEEL_BITS - 1) / TIMER_WHEEL_BITS)
+
+/* Slot index of 'tick' in level 'level' of the timer wheel. */
+#define TIMER_WHEEL_INDEX(tick, level) \
+   (((tick) >> (TIMER_WHEEL_BITS * (level))) & (TIMER_WHEEL_SLOTS - 1))
+
+/* Records a kernel event in the trace buffer, if tracing is configured.
+   Interrupts must be disabled. */
+#ifdef RTOS_TRACE
+#if (RTOS_TRACE_RECORDS & (RTOS_TRACE_RECORDS - 1)) != 0
+#error "RTOS_TRACE_RECORDS must be a power of 2"
+#endif
+#define TRACE(event, pid, arg) trace_record((event), (pid), (arg))
+#else
+#define TRACE(event, pid, arg) do { } while (0)
+#endif
+
+/* The pid to trace for the holder of a buffer, which is 0 for an interrupt
+   handler. */
+#define HOLDER_PID(holder) \
+   ((holder) != 0 ? (holder)->pid : RTOS_TRACE_NO_PID)
+
+/* Critical sections of the kernel entry points, site 'site' for the
+   profiler. 'saved' is an rtos_u32 holding the interrupt mask to restore.
+   CRITICAL_PROFILE_START/STOP measure a section that masks interrupts in
+   some other way. */
+#ifdef RTOS_CRITICAL_PROFILE
+#define CRITICAL_PROFILE_START() rtos_critical_profile_start()
+#define CRITICAL_PROFILE_STOP(site) rtos_critical_profile_stop(site)
+#else
+#define CRITICAL_PROFILE_START() do { } while (0)
+#define CRITICAL_PROFILE_STOP(site) do { } while (0)
+#endif
+
+#define CRITICAL_ENTER(site, saved) \
+   do { INTERRUPT_DISABLE_SAVE(saved); CRITICAL_PROFILE_START(); } while (0)
+#define CRITICAL_EXIT(site, saved) \
+   do { CRITICAL_PROFILE_STOP(site); INTERRUPT_ENABLE_SAVED(saved); } while (0)
 
-/* The buffer header consists of a magic number and a next-pointer. */
-#define BUFFER_HEADER_SIZE 8
+/* Bit representing 'inbox' in an inbox mask. */
+#define INBOX_BIT(inbox) (1u << (inbox))
+
+/* Non-zero if 'mask' selects at least one inbox and no inbox beyond the
+   last one. */
+#define INBOX_MASK_VALID(mask)                                          \
+   ((mask) != 0 && ((mask) & ~(0xFFFFFFFFu >> (32 - PCB_NBR_INBOXES))) == 0)
+
+/* Buffer size classes in bytes, in ascending order, and the number of
+   buffers of each size to allocate already in rtos_init. Configured from
+   config.mk. The sizes must be multiples of 4. */
+#ifndef RTOS_BUFFER_SIZES
+#define RTOS_BUFFER_SIZES 16,64,512
+#endif
+
+#ifndef RTOS_BUFFER_PREALLOC
+#define RTOS_BUFFER_PREALLOC 0,0,0
+#endif
+
+#define NBR_BUFFER_POOLS (sizeof(buffer_sizes) / sizeof(buffer_sizes[0]))
+
+/* The size-to-pool lookup table has one entry per 4 bytes of buffer size. */
+#define POOL_LOOKUP_SHIFT 2
+#define POOL_LOOKUP_INDEX(size) \
+   (((size) + (1 << POOL_LOOKUP_SHIFT) - 1) >> POOL_LOOKUP_SHIFT)
+
+/* The buffer header consists of a magic number, a free-list next-pointer,
+   an inbox node, the number of references to the buffer and the index of
+   the pool that the buffer belongs to. */
+#define BUFFER_HEADER_SIZE sizeof(BufferHeader)
 #define BUFFER_HEADER_MAGIC 0x11223344
 
+/* The owner of a buffer allocated by an interrupt handler, until a process
+   receives it. Like a pid of no process in the trace. */
+#define BUFFER_OWNER_NONE 0xFFFF
+
 /* The buffer trailer consists of a magic number. */
 #define BUFFER_TRAILER_SIZE 4
 #define BUFFER_TRAILER_MAGIC 0x55667788
 
-typedef struct BufferHeader
+/* The trailer of a buffer, after its data. */
+#define BUFFER_TRAILER(buffer_header)                                   \
+   ((BufferTrailer *) (((rtos_address) (buffer_header)) +               \
+                       BUFFER_HEADER_SIZE +                             \
+                       buffer_sizes[(buffer_header)->pool]))
+
+/* Stacks are painted with this word, with PROCESS_STATS, to find how deep
+   they have been used. */
+#define STACK_PAINT 0xA5A5A5A5u
+
+/* Non-zero if 'flags' satisfy a wait for 'mask' with 'options'. */
+#define EVENT_SATISFIED(flags, mask, options)                   \
+   (((options) & RTOS_EVENT_WAIT_ALL) != 0 ?                    \
+    ((flags) & (mask)) == (mask) : ((flags) & (mask)) != 0)
+
+#if RTOS_WORK_QUEUES > 0
+/* A call posted with rtos_defer_from_isr. */
+typedef struct
+{
+   rtos_work_function function;
+   rtos_address       arg;
+} WorkItem;
+
+/* A single-producer, single-consumer ring of work items. 'head' counts the
+   items posted and is written by the interrupt handler only, 'tail' counts
+   the items run and is written by the work process only. Both wrap, and
+   the queue holds 'head - tail' items. */
+typedef struct
+{
+   volatile rtos_u32  head;
+   volatile rtos_u32  tail;
+   WorkItem           items[RTOS_WORK_QUEUE_ITEMS];
+} WorkQueue;
+#endif
+
+#ifdef RTOS_BUFFER_STATS
+/* The usage of a buffer pool. 'nbr_buffers' counts the buffers created for
+   the pool, 'nbr_used' those allocated and not yet freed. */
+typedef struct
 {
-      rtos_u32            magic;
-      struct BufferHeader *next;
-} BufferHeader;
+   rtos_u32 nbr_buffers;
+   rtos_u32 nbr_used;
+   rtos_u32 peak_used;
+   rtos_u32 alloc_failures;
+} PoolStats;
+#endif
 
-typedef struct BufferTrailer
+/* Corruption reported by the auditor in 'rtos_audit_error'. */
+typedef enum
 {
-      rtos_u32            magic;
-} BufferTrailer;
+   AUDIT_OK,
+   AUDIT_ERROR_READY_QUEUE,  /* Detail: core << 8 | priority. */
+   AUDIT_ERROR_TIMER_WHEEL,  /* Detail: level << 8 | slot index. */
+   AUDIT_ERROR_INBOX,        /* Detail: pid << 8 | inbox. */
+   AUDIT_ERROR_FREE_LIST,    /* Detail: pool. */
+   AUDIT_ERROR_MUTEX,        /* Detail: mutex id. */
+   AUDIT_ERROR_EVENT_GROUP   /* Detail: event group id. */
+} AuditError;
 
 
 /******************************************************************************
  * Local Function Prototypes
  *****************************************************************************/
 
+#if RTOS_CHECK_LEVEL >= 1
 /* assertion_failed - Called if an assertion failed. Loops forever. */
 static void assertion_failed(void);
+#endif
 
-/* rtosint_yield - Called from syscall to handle the 'yield' syscall. The
-   current process is sorted into the ready-list and one of the highest-
-   priority processes is taken out. A context switch is scheduled using the
-   'arch_trigger_pendsv' to take place when all currently active exceptions
-   are handled. */
+/* rtosint_yield - Called from syscall to handle the 'yield' syscall. A
+   context switch is scheduled using the 'arch_trigger_pendsv' to take place
+   when all currently active exceptions are handled. The current process is
+   then put last in the ready-list and one of the highest-priority processes
+   is taken out. */
 static void rtosint_yield();
 
 /* rtosint_alloc - Called from syscall to handle the 'alloc' syscall. Try to
-   find a buffer in corresponding free-list. If not available there; allocate
-   from RAM space. */
+   find a buffer in the free-list of the smallest buffer size that fits. If
+   not available there; allocate from RAM space. Returns 0 if the requested
+   size is larger than the largest configured buffer size. */
 static rtos_address rtosint_alloc(rtos_u32 nbr_bytes);
 
 static void rtosint_send(rtos_address buffer_address, rtos_u32 dest_pid, rtos_u32 dest_inbox);
@@ -73,19 +313,201 @@ static void rtosint_wait_psem();
 static void rtosint_signal_psem(rtos_u32 pid);
 static rtos_u32 rtosint_current_pid();
 
+/* rtosint_receive_any - Called from syscall to handle the 'receive_any'
+   syscall. Like rtosint_receive, but waits for a message in any of the
+   inboxes set in 'inbox_mask' and tells which inbox it was taken from. */
+static rtos_address rtosint_receive_any(rtos_u32 inbox_mask,
+                                        rtos_u32 *received_inbox);
+
+/* rtosint_inbox_count - Called from syscall to handle the 'inbox_count'
+   syscall. Returns the number of messages waiting in an inbox of the
+   current process. */
+static rtos_u32 rtosint_inbox_count(rtos_u32 inbox);
+
+/* rtosint_receive_timeout, rtosint_receive_any_timeout - Called from
+   syscall to handle the 'receive_timeout' and 'receive_any_timeout'
+   syscalls. Like rtosint_receive and rtosint_receive_any, but return 0 if
+   no message has arrived within 'nbr_ticks' ticks. */
+static rtos_address rtosint_receive_timeout(rtos_u32 inbox,
+                                            rtos_u32 nbr_ticks);
+static rtos_address rtosint_receive_any_timeout(rtos_u32 inbox_mask,
+                                                rtos_u32 *received_inbox,
+                                                rtos_u32 nbr_ticks);
+
+/* rtosint_wait_psem_timeout - Called from syscall to handle the
+   'wait_psem_timeout' syscall. Like rtosint_wait_psem, but returns 0 if the
+   psem has not been signaled within 'nbr_ticks' ticks, otherwise 1. */
+static rtos_u32 rtosint_wait_psem_timeout(rtos_u32 nbr_ticks);
+
+/* rtosint_process_stats - Called from syscall to handle the
+   'process_stats' syscall. Copies the CPU time and stack usage of a
+   process. */
+static rtos_u32 rtosint_process_stats(rtos_u32 pid,
+                                      rtos_process_usage *usage);
+
+/* rtosint_alloc_priority, rtosint_set_message_priority - Called from
+   syscall to handle the 'alloc_priority' and 'set_message_priority'
+   syscalls. Give a buffer a message priority, when allocated or later. */
+static rtos_address rtosint_alloc_priority(rtos_u32 nbr_bytes,
+                                           rtos_u32 priority);
+static void rtosint_set_message_priority(rtos_address buffer_address,
+                                         rtos_u32 priority);
+
+/* rtosint_migrate - Called from syscall to handle the 'migrate' syscall.
+   Moves the current process to another core. */
+static void rtosint_migrate(rtos_u32 core);
+
+/* rtosint_current_core - Called from syscall to handle the 'current_core'
+   syscall. Returns the core that the current process runs on. */
+static rtos_u32 rtosint_current_core(void);
+
+/* rtosint_send_batch, rtosint_receive_all - Called from syscall to handle
+   the 'send_batch' and 'receive_all' syscalls. Send several buffers to one
+   inbox, and take several messages out of one inbox, in one syscall. */
+static void rtosint_send_batch(const rtos_address *buffers,
+                               rtos_u32 nbr_buffers,
+                               const rtos_destination *destination);
+static rtos_u32 rtosint_receive_all(rtos_u32 inbox, rtos_address *buffers,
+                                    rtos_u32 max_buffers);
+
+/* rtosint_send_multicast - Called from syscall to handle the
+   'send_multicast' syscall. Sends one buffer to several destinations,
+   counting a reference for each. */
+static void rtosint_send_multicast(rtos_address buffer_address,
+                                   const rtos_destination *destinations,
+                                   rtos_u32 nbr_destinations);
+
+/* rtosint_critical_stats - Called from syscall to handle the
+   'critical_stats' syscall. Copies the statistics of a critical-section
+   site. */
+static rtos_u32 rtosint_critical_stats(rtos_u32 site,
+                                       rtos_critical_site_stats *stats);
+
+/* rtosint_pool_stats, rtosint_buffers_held - Called from syscall to handle
+   the 'pool_stats' and 'buffers_held' syscalls. Copy the usage of a buffer
+   pool, and count the buffers owned by a process. */
+static rtos_u32 rtosint_pool_stats(rtos_u32 pool, rtos_pool_usage *usage);
+static rtos_u32 rtosint_buffers_held(rtos_u32 pid);
+
+/* rtosint_mutex_lock - Called from syscall to handle the 'mutex_lock'
+   syscall. Takes a free mutex, or puts the current process among its
+   waiters and lets the owner inherit its priority. */
+static void rtosint_mutex_lock(rtos_u32 mutex_id);
+
+/* rtosint_mutex_unlock - Called from syscall to handle the 'mutex_unlock'
+   syscall. Hands the mutex over to the first waiter, if any, and drops the
+   priority inherited through it. */
+static void rtosint_mutex_unlock(rtos_u32 mutex_id);
+
+/* rtosint_event_wait - Called from syscall to handle the 'event_wait'
+   syscall. Returns the flags of the event group if they satisfy the wait,
+   otherwise the current process waits in PROCESS_STATE_EVENT. */
+static rtos_u32 rtosint_event_wait(rtos_u32 group_id, rtos_u32 mask,
+                                   rtos_u32 options);
+
+/* rtosint_event_set - Called from syscall to handle the 'event_set'
+   syscall. Sets flags and wakes the satisfied waiters in one pass. */
+static void rtosint_event_set(rtos_u32 group_id, rtos_u32 flags);
+
+/* rtosint_event_clear - Called from syscall to handle the 'event_clear'
+   syscall. */
+static rtos_u32 rtosint_event_clear(rtos_u32 group_id, rtos_u32 flags);
+
 static void readylist_insert_pcb(PCB *pcb);
+static PCB *readylist_remove_highest(rtos_u32 core);
+static void readylist_remove_pcb(PCB *pcb);
+static int preempts_current(PCB *pcb);
+static void mutex_waiters_insert(Mutex *mutex, PCB *pcb);
+static void mutex_waiters_remove(Mutex *mutex, PCB *pcb);
+static rtos_u8 mutex_inherited_priority(PCB *pcb);
+static void process_set_priority(PCB *pcb, rtos_u8 priority);
 static void receivelist_insert_pcb(PCB *pcb);
+static rtos_address receive_from_inboxes(rtos_u32 inbox_mask,
+                                         rtos_u32 *received_inbox,
+                                         rtos_address *received_buffer,
+                                         rtos_u32 nbr_ticks);
+static rtos_u32 psem_wait(rtos_u32 nbr_ticks);
+static int psem_signal(PCB *pcb);
+static int message_deliver(PCB *dest_pcb, rtos_u32 dest_inbox,
+                           const rtos_address *buffers,
+                           rtos_u32 nbr_buffers);
+static BufferHeader *inbox_take(PCB *pcb, rtos_u32 inbox_mask,
+                                rtos_u32 *received_inbox);
+static void inbox_append(PCB *pcb, rtos_u32 inbox, MessageRef *ref);
+static BufferHeader *inbox_remove_first(PCB *pcb, rtos_u32 inbox);
+static rtos_u32 inbox_detach(PCB *pcb, rtos_u32 inbox, rtos_u32 max_messages,
+                             MessageRef **detached);
+static rtos_address buffer_alloc(rtos_u32 wanted_size, PCB *holder);
+static void buffer_dispose(rtos_address buffer_address, PCB *holder);
+static void message_send(rtos_address buffer_address, rtos_u32 dest_pid,
+                         rtos_u32 dest_inbox);
+static MessageRef *message_ref_get(BufferHeader *buffer_header);
+static void message_ref_free(MessageRef *ref);
+#ifdef RTOS_BUFFER_STATS
+static void buffer_owner_set(BufferHeader *buffer_header, PCB *pcb);
+#endif
 static void delaylist_insert_pcb(PCB *pcb, rtos_u32 nbr_ticks);
+static void delaylist_remove_pcb(PCB *pcb);
+static void timerwheel_insert(PCB *pcb);
+static int timerwheel_advance(void);
 static rtos_address kernel_alloc_permanent(rtos_u32 size, rtos_u8 alignment);
+static rtos_u32 process_create(rtos_address entry, rtos_u16 stack_size,
+                               rtos_u8 priority, rtos_u32 core);
+static rtos_u32 process_init(PCB *pcb, rtos_address entry,
+                             rtos_address stack_base, rtos_u16 stack_size,
+                             rtos_u8 priority, rtos_u32 core);
+#ifdef RTOS_STATIC_CONFIG
+static void static_config_init(void);
+#else
+static void dynamic_config_init(void);
+#endif
+#ifdef RTOS_PROCESS_STATS
+static rtos_u32 stack_high_water(PCB *pcb);
+#endif
+static void idle_process(void);
+#if RTOS_WORK_QUEUES > 0
+static void work_process(void);
+static void work_queue_run(WorkQueue *queue);
+#endif
+static void ticks_advance(rtos_u32 nbr_ticks);
+#if RTOS_TIME_SLICE > 0
+static void time_slice_tick(void);
+#endif
+#ifdef RTOS_TICKLESS_IDLE
+static void idle_sleep(void);
+static rtos_u32 timerwheel_next_event(void);
+#endif
+static BufferHeader *buffer_create(rtos_u32 pool);
+static void buffer_init(BufferHeader *buffer_header, rtos_u32 pool);
+static void buffer_pools_init(void);
+#ifdef RTOS_TRACE
+static inline void trace_record(rtos_u8 event, rtos_u32 pid, rtos_u32 arg);
+#endif
+#if RTOS_CHECK_LEVEL >= 2
+static void audit_failed(rtos_u32 error, rtos_u32 detail);
+static int audit_buffer(BufferHeader *buffer_header);
+static void audit_ready_queue(rtos_u32 core, rtos_u32 priority);
+static void audit_timer_wheel_slot(rtos_u32 level, rtos_u32 index);
+static void audit_inboxes(PCB *pcb);
+static void audit_free_list(rtos_u32 pool);
+static void audit_mutex(rtos_u32 mutex_id);
+static void audit_event_group(rtos_u32 group_id);
+static void kernel_audit(void);
+#endif
 
 /*****************************************************************************
  * Variable Declarations
  *****************************************************************************/
 
-extern rtos_address _kernel_pool_start; /* From linker script. */
+extern rtos_address _kernel_pool_start[]; /* From linker script. */
 
+#if RTOS_NBR_CORES > 1
+PCB *rtos_current_pcbs[RTOS_NBR_CORES];
+PCB *rtos_new_pcbs[RTOS_NBR_CORES];
+#else
 PCB *new_pcb = 0;
 PCB *current_pcb = 0;
+#endif
 
 /* An array of pointers to portable system call handlers. This array is used
    to perform jumps from architecture specific code directly to the
@@ -101,64 +523,166 @@ void *syscall_pointers[] =
    rtosint_delay,
    rtosint_wait_psem,
    rtosint_signal_psem,
-   rtosint_current_pid
+   rtosint_current_pid,
+   rtosint_receive_any,
+   rtosint_inbox_count,
+   rtosint_send_multicast,
+   rtosint_critical_stats,
+   rtosint_mutex_lock,
+   rtosint_mutex_unlock,
+   rtosint_event_wait,
+   rtosint_event_set,
+   rtosint_event_clear,
+   rtosint_receive_timeout,
+   rtosint_receive_any_timeout,
+   rtosint_wait_psem_timeout,
+   rtosint_process_stats,
+   rtosint_alloc_priority,
+   rtosint_set_message_priority,
+   rtosint_migrate,
+   rtosint_current_core,
+   rtosint_send_batch,
+   rtosint_receive_all,
+   rtosint_pool_stats,
+   rtosint_buffers_held
 };
 
+#define NBR_SYSCALLS (sizeof(syscall_pointers) / sizeof(syscall_pointers[0]))
+
 static rtos_address permanent_data_ptr;
-static PCB *ready_pcbs = 0;
+
+/* The ready-queues, one per core. One FIFO of PCBs per priority level,
+   linked through 'next', and a bitmap telling which of the FIFOs are
+   non-empty. */
+static PCB *ready_heads[RTOS_NBR_CORES][RTOS_NBR_PRIORITIES];
+static PCB *ready_tails[RTOS_NBR_CORES][RTOS_NBR_PRIORITIES];
+static rtos_u32 ready_bitmap[RTOS_NBR_CORES];
+
+#if RTOS_NBR_CORES > 1
+/* Spinlocks, see the top of this file. 'trace_lock' and 'profile_lock'
+   protect the trace buffer and the critical-section statistics, and are
+   taken last. */
+static volatile rtos_u32 kernel_lock = 0;
+static volatile rtos_u32 alloc_lock = 0;
+#ifdef RTOS_TRACE
+static volatile rtos_u32 trace_lock = 0;
+#endif
+#ifdef RTOS_CRITICAL_PROFILE
+static volatile rtos_u32 profile_lock = 0;
+#endif
+#endif
+
 static PCB *receive_pcbs = 0;
-static PCB *delay_pcbs = 0;
-static PCB **pid_pcb_map = 0;
+
+/* The delaylist, a hierarchical timer wheel. Slot 'index' of level 'level'
+   holds the delayed PCBs, linked through 'next', whose 'delay_until' has
+   'index' in bit field 'level' and that are too far away in time to be held
+   in a lower level. */
+static PCB *timer_wheel[TIMER_WHEEL_LEVELS][TIMER_WHEEL_SLOTS];
+static PCB *const *pid_pcb_map = 0;
 static rtos_u32 next_pid = 0;
-static BufferHeader *available_list = 0;
+
+/* The mutexes, by id. Until the kernel is started, 'mutex_list' holds the
+   created mutexes, newest first. */
+static Mutex *const *mutex_map = 0;
+static Mutex *mutex_list = 0;
+static rtos_u32 next_mutex_id = 0;
+
+/* The event groups, by id, and likewise the list of created ones. */
+static EventGroup *const *event_group_map = 0;
+static EventGroup *event_group_list = 0;
+static rtos_u32 next_event_group_id = 0;
+
+/* Buffer pools. One free-list per configured buffer size, and a table that
+   maps a requested size to the smallest pool with buffers that fit. */
+static const rtos_u32 buffer_sizes[] = { RTOS_BUFFER_SIZES };
+static const rtos_u32 buffer_prealloc[] = { RTOS_BUFFER_PREALLOC };
+static BufferHeader *available_lists[NBR_BUFFER_POOLS];
+static rtos_u8 *pool_lookup = 0;
+
+#ifdef RTOS_BUFFER_STATS
+/* The usage of each pool, under the allocator lock like the free-lists. */
+static PoolStats pool_stats[NBR_BUFFER_POOLS];
+#endif
+
+/* Free inbox nodes for multicast messages. */
+static MessageRef *free_refs = 0;
 
 static rtos_u32 current_tick = 0;
 
+#if RTOS_TIME_SLICE > 0
+/* Ticks left of the time slice of the current process of each core, set
+   when a process is switched in. */
+static rtos_u32 slice_ticks_left[RTOS_NBR_CORES];
+#endif
+
+#if RTOS_WORK_QUEUES > 0
+/* The deferred work queues and the process that runs their items. An
+   interrupt handler that posts work sets 'work_pending' and schedules a
+   context switch, where rtos_reschedule_hook clears it and signals the
+   work process. */
+static WorkQueue work_queues[RTOS_WORK_QUEUES];
+static volatile rtos_u32 work_pending = 0;
+static PCB *work_pcb = 0;
+#endif
+
+#if RTOS_CHECK_LEVEL >= 2
+/* Corruption found by the auditor: one of the AUDIT_ERROR codes and a
+   detail telling where, e.g. a pid or a priority. Read by the debugger, as
+   the auditor stops the system. 'rtos_audit_passes' counts the completed
+   audits of all kernel data. */
+rtos_u32 rtos_audit_error = AUDIT_OK;
+rtos_u32 rtos_audit_detail = 0;
+rtos_u32 rtos_audit_passes = 0;
+#endif
+
+#ifdef RTOS_CRITICAL_PROFILE
+/* Interrupt masking statistics per critical-section site, and the time
+   stamp and nesting depth of the current critical section of each core. */
+static rtos_critical_site_stats
+critical_stats[RTOS_CRITICAL_SITE_SYSCALL + NBR_SYSCALLS];
+static rtos_u32 critical_start[RTOS_NBR_CORES];
+static rtos_u32 critical_depth[RTOS_NBR_CORES];
+#endif
+
+#ifdef RTOS_PROCESS_STATS
+/* Time stamp of the latest context switch of each core, from which its
+   current process has run. */
+static rtos_u32 switch_timestamp[RTOS_NBR_CORES];
+#endif
+
+#ifdef RTOS_TRACE
+/* The trace buffer, found by the debugger or the application through its
+   symbol. */
+RtosTrace rtos_trace =
+{
+   RTOS_TRACE_MAGIC,
+   RTOS_TRACE_VERSION,
+   sizeof(RtosTraceRecord),
+   RTOS_TRACE_RECORDS,
+   RTOS_TRACE_TIMESTAMP_HZ,
+   0,
+   { { 0, 0, 0, 0 } }
+};
+#endif
+
 /*****************************************************************************
  * Function Implementations
  *****************************************************************************/
 
+#if RTOS_CHECK_LEVEL >= 1
 static void assertion_failed(void)
 {
   while (1);
 }
-
-static void list_failed(void)
-{
-  while (1);
-}
-
-static void test_list(PCB *list)
-{
-  int depth = 0;
-  while (list) {
-    list = list->next;
-    depth++;
-    if (depth > 16) list_failed();
-  }
-}
-
-static void test_lists(void)
-{
-  test_list(ready_pcbs);
-  test_list(delay_pcbs);
-}
+#endif
 
 static void rtosint_yield()
 {
-   /* Possible races:
-      1. An interrupt triggers an rtosint_tick, which may do the following:
-         - Insert processes in the readylist.
-	 - Change state of current_pcb to PROCESS_STATE_READY.
-	 - Update new_pcb.
-	 - Update ready_pcbs.
-
-      Notes:
-        current_pcb is constant throughout the invocation of this function.
-   */
-   readylist_insert_pcb(current_pcb);
-
    /* Schedule a context switch to take place after all active exceptions.
+      The current process stays RUNNING until then, and rtos_reschedule_hook
+      puts it last in the readylist of its priority, so that it only gives
+      way to ready processes of the same or higher priority.
       TODO: 'arch_trigger_pendsv' should have a better name, as it is a
       Cortex-M3 exception name. */
    arch_trigger_pendsv();
@@ -166,237 +690,502 @@ static void rtosint_yield()
 
 static rtos_address rtosint_alloc(rtos_u32 wanted_size)
 {
-   rtos_u32 actual_size = 0;
-   rtos_address buffer = 0;
+   return buffer_alloc(wanted_size, current_pcb);
+}
+
+/******************************************************************************
+ * Function: buffer_alloc
+ *
+ * Allocates a buffer like rtosint_alloc, and counts it as held by 'holder',
+ * unless that is 0 for an interrupt handler.
+ */
+static rtos_address buffer_alloc(rtos_u32 wanted_size, PCB *holder)
+{
+   BufferHeader *buffer_header = 0;
+   rtos_u32 pool = 0;
 
-   /* Find out the size of buffer to use, using the configured list
-      of buffer sizes. TODO: Implement configured sizes. */
-   (void) wanted_size;
-   actual_size = 64;
+   /* Find out the pool to use, using the configured list of buffer
+      sizes. */
+   if (wanted_size > buffer_sizes[NBR_BUFFER_POOLS - 1])
+   {
+      return 0;
+   }
+   pool = pool_lookup[POOL_LOOKUP_INDEX(wanted_size)];
+   TRACE(RTOS_TRACE_ALLOC, HOLDER_PID(holder), wanted_size);
 
    /* Look in free-list for available buffer of suitable size. */
-   INTERRUPT_DISABLE;
-   if (available_list != 0)
+   SPIN_LOCK(&alloc_lock);
+   if (available_lists[pool] != 0)
+   {
+      buffer_header = available_lists[pool];
+      available_lists[pool] = buffer_header->next;
+   }
+   else
+   {
+      /* If buffer is not available in free-list, then allocate from RAM
+         space: */
+      buffer_header = buffer_create(pool);
+   }
+#ifdef RTOS_BUFFER_STATS
+   if (buffer_header == 0)
    {
-      BufferHeader *buffer_header = available_list;
-      available_list = buffer_header->next;
-      INTERRUPT_ENABLE;
-      buffer = ((rtos_address)buffer_header) + BUFFER_HEADER_SIZE;
+      pool_stats[pool].alloc_failures++;
    }
    else
    {
-   /* If buffer is not available in free-list, then allocate from RAM
-      space: */
-      buffer = kernel_alloc_permanent(BUFFER_HEADER_SIZE + actual_size
-                                      + BUFFER_TRAILER_SIZE, 4);
-      INTERRUPT_ENABLE;
+      if (++pool_stats[pool].nbr_used > pool_stats[pool].peak_used)
+      {
+         pool_stats[pool].peak_used = pool_stats[pool].nbr_used;
+      }
+      buffer_header->owner = BUFFER_OWNER_NONE;
+      if (holder != 0)
+      {
+         buffer_header->owner = holder->pid;
+         holder->buffers_held++;
+      }
+   }
+#else
+   (void) holder;
+#endif
+   SPIN_UNLOCK(&alloc_lock);
+
+   if (buffer_header == 0)
+   {
+      return 0;
+   }
+   buffer_header->next = 0;
+   buffer_header->refcount = 1;
+   buffer_header->priority = 0;
+
+   return ((rtos_address)buffer_header) + BUFFER_HEADER_SIZE;
+}
+
+static rtos_address rtosint_alloc_priority(rtos_u32 nbr_bytes,
+                                           rtos_u32 priority)
+{
+   rtos_address buffer_address = rtosint_alloc(nbr_bytes);
+
+   if (buffer_address != 0)
+   {
+      rtosint_set_message_priority(buffer_address, priority);
+   }
+
+   return buffer_address;
+}
 
-      ((BufferHeader *)buffer)->magic = BUFFER_HEADER_MAGIC;
-      ((BufferHeader *)buffer)->next = 0;
-      ((BufferTrailer *)(buffer + BUFFER_HEADER_SIZE + actual_size))->magic =
-	 BUFFER_TRAILER_MAGIC;
+static void rtosint_set_message_priority(rtos_address buffer_address,
+                                         rtos_u32 priority)
+{
+   BufferHeader *buffer_header =
+      (BufferHeader *)(buffer_address - BUFFER_HEADER_SIZE);
+
+   kernel_assert(buffer_header->magic == BUFFER_HEADER_MAGIC);
 
-      buffer += BUFFER_HEADER_SIZE;
+   /* The inboxes are ordered by the priority, so it must not change while
+      the buffer is queued, in one inbox or, multicast, in several. */
+   kernel_assert(buffer_header->refcount == 1 && !buffer_header->ref_used);
+
+   if (priority >= RTOS_MESSAGE_PRIORITIES)
+   {
+      priority = RTOS_MESSAGE_PRIORITIES - 1;
    }
-   return buffer;
+   buffer_header->priority = priority;
 }
 
 static void rtosint_send(rtos_address buffer_address, rtos_u32 dest_pid,
                   rtos_u32 dest_inbox)
 {
-   PCB *dest_pcb = pid_pcb_map[dest_pid];
+#ifdef RTOS_BUFFER_STATS
+   current_pcb->buffers_held--;
+#endif
+   message_send(buffer_address, dest_pid, dest_inbox);
+}
+
+/******************************************************************************
+ * Function: message_send
+ *
+ * Sends a buffer like rtosint_send, without counting it as given up by the
+ * current process, which an interrupt handler does not send for.
+ */
+static void message_send(rtos_address buffer_address, rtos_u32 dest_pid,
+                         rtos_u32 dest_inbox)
+{
+   kernel_assert(((BufferHeader *) (buffer_address - BUFFER_HEADER_SIZE))->magic
+                 == BUFFER_HEADER_MAGIC);
+
+   /* The reference of the sender is passed on to the receiver. */
+   if (message_deliver(pid_pcb_map[dest_pid], dest_inbox, &buffer_address, 1))
+   {
+      /* Schedule a context switch. */
+      arch_trigger_pendsv();
+   }
+}
+
+static void rtosint_send_multicast(rtos_address buffer_address,
+                                   const rtos_destination *destinations,
+                                   rtos_u32 nbr_destinations)
+{
    BufferHeader *buffer_header = (BufferHeader *)(buffer_address - BUFFER_HEADER_SIZE);
+   rtos_u32 index = 0;
+   int do_schedule = 0;
 
-   buffer_header->next = 0;
+   kernel_assert(buffer_header->magic == BUFFER_HEADER_MAGIC);
 
-   /* Deliver the message. */
-   //INTERRUPT_DISABLE;
-   if (dest_pcb->inbox[dest_inbox] == 0)
+   if (nbr_destinations == 0)
    {
-      /* No buffer in inbox. */
-      if (dest_pcb->process_state == PROCESS_STATE_RECEIVE &&
-          dest_pcb->receive_from == dest_inbox)
-      {
-	 /* Destination process is in RECEIVE and shall return from the
-	    receive call with this message, as it is the only message in it's
-	    inbox. */
-	 dest_pcb->process_state = PROCESS_STATE_READY;
-	 readylist_insert_pcb(dest_pcb);
-	 arch_store_retval(buffer_address, dest_pcb);
+      /* Nobody to pass the reference of the sender on to. */
+      rtosint_dispose(buffer_address);
+      return;
+   }
 
-	 if (dest_pcb->priority < current_pcb->priority)
-	 {
-	    current_pcb->process_state = PROCESS_STATE_READY;
-	    readylist_insert_pcb(current_pcb);
+   /* The reference of the sender is passed on to the first receiver, the
+      others get one each. */
+#ifdef RTOS_BUFFER_STATS
+   current_pcb->buffers_held--;
+#endif
+   SPIN_LOCK(&alloc_lock);
+   kernel_assert(buffer_header->refcount + nbr_destinations - 1 <= 0xFFFF);
+   buffer_header->refcount += nbr_destinations - 1;
+   SPIN_UNLOCK(&alloc_lock);
 
-	    /* Schedule a context switch. */
-	    arch_trigger_pendsv();
-	 }
-      }
-      else
+   for (index = 0; index < nbr_destinations; index++)
+   {
+      if (message_deliver(pid_pcb_map[destinations[index].pid],
+                          destinations[index].inbox, &buffer_address, 1))
       {
-	 /* Recipient is NOT waiting for a message on this inbox. */
-	 dest_pcb->inbox[dest_inbox] = buffer_header;
+         do_schedule = 1;
       }
    }
-   else
+
+   if (do_schedule)
+   {
+      arch_trigger_pendsv();
+   }
+}
+
+static void rtosint_send_batch(const rtos_address *buffers,
+                               rtos_u32 nbr_buffers,
+                               const rtos_destination *destination)
+{
+   /* The references of the sender are passed on to the receiver, all under
+      one hold of its inbox lock. */
+#ifdef RTOS_BUFFER_STATS
+   current_pcb->buffers_held -= nbr_buffers;
+#endif
+   if (nbr_buffers != 0 &&
+       message_deliver(pid_pcb_map[destination->pid], destination->inbox,
+                       buffers, nbr_buffers))
    {
-      /* At least one buffer in inbox. Follow list and put new message at the
-	 end of it. TODO: Optimize by keeping a pointer to the last message.
-	 No need to schedule here, because even if the destination process is
-	 in RECEIVE, it must be lower than or equal than current process
-	 (otherwise it would be running now), so we should not switch to it. */
-      BufferHeader *dest_inbox_iter = dest_pcb->inbox[dest_inbox];
+      arch_trigger_pendsv();
+   }
+}
+
+static rtos_u32 rtosint_receive_all(rtos_u32 inbox, rtos_address *buffers,
+                                    rtos_u32 max_buffers)
+{
+   MessageRef *ref = 0;
+   MessageRef *next = 0;
+   rtos_address received = 0;
+   rtos_u32 count = 0;
+   rtos_u32 index = 0;
+
+   kernel_assert(inbox < PCB_NBR_INBOXES);
+   kernel_assert(max_buffers != 0);
 
-      while (dest_inbox_iter->next != 0)
+   SPIN_LOCK(&current_pcb->inbox_lock);
+   count = inbox_detach(current_pcb, inbox, max_buffers, &ref);
+   SPIN_UNLOCK(&current_pcb->inbox_lock);
+
+   if (count == 0)
+   {
+      /* Wait like rtosint_receive. A message that arrives is stored in
+         'buffers' by message_deliver, which returns 1. */
+      received = receive_from_inboxes(INBOX_BIT(inbox), 0, buffers,
+                                      RTOS_WAIT_FOREVER);
+      if (received != 0)
       {
-	 dest_inbox_iter = dest_inbox_iter->next;
+         buffers[0] = received;
+         count = 1;
       }
-      dest_inbox_iter->next = buffer_header;
+      return count;
    }
-   //INTERRUPT_ENABLE;
+
+   /* The detached inbox nodes are released with one hold of the allocator
+      lock, and without holding the inbox lock. */
+   SPIN_LOCK(&alloc_lock);
+   for (index = 0; index < count; index++)
+   {
+      TRACE(RTOS_TRACE_RECEIVE, current_pcb->pid, inbox);
+      next = ref->next;
+      buffers[index] = ((rtos_address) ref->buffer) + BUFFER_HEADER_SIZE;
+#ifdef RTOS_BUFFER_STATS
+      buffer_owner_set(ref->buffer, current_pcb);
+#endif
+      message_ref_free(ref);
+      ref = next;
+   }
+   SPIN_UNLOCK(&alloc_lock);
+
+   return count;
 }
 
-static rtos_address rtosint_receive(rtos_u32 inbox)
+static rtos_u32 rtosint_critical_stats(rtos_u32 site,
+                                       rtos_critical_site_stats *stats)
 {
-   BufferHeader *received = 0;
+#ifdef RTOS_CRITICAL_PROFILE
+   if (site < RTOS_CRITICAL_SITE_SYSCALL + NBR_SYSCALLS)
+   {
+      SPIN_LOCK(&profile_lock);
+      *stats = critical_stats[site];
+      SPIN_UNLOCK(&profile_lock);
+      return 1;
+   }
+#else
+   (void) site;
+   (void) stats;
+#endif
+   return 0;
+}
+
+static rtos_u32 rtosint_process_stats(rtos_u32 pid,
+                                      rtos_process_usage *usage)
+{
+#ifdef RTOS_PROCESS_STATS
+   PCB *pcb = 0;
 
-   if (current_pcb->inbox[inbox] != 0)
+   if (pid < next_pid)
    {
-      /* Message waiting in inbox. */
-      received = current_pcb->inbox[inbox];
-      current_pcb->inbox[inbox] = current_pcb->inbox[inbox]->next;
-      return ((rtos_address) received) + BUFFER_HEADER_SIZE;
+      pcb = pid_pcb_map[pid];
+      KERNEL_LOCK();
+      usage->run_cycles = pcb->run_cycles;
+      if (pcb == current_pcb)
+      {
+         usage->run_cycles +=
+            RTOS_TRACE_TIMESTAMP() - switch_timestamp[ARCH_CORE_ID()];
+      }
+      usage->switch_count = pcb->switch_count;
+      KERNEL_UNLOCK();
+      usage->stack_size = pcb->stack_size;
+      usage->stack_used = stack_high_water(pcb);
+      return 1;
    }
-   else
+#else
+   (void) pid;
+   (void) usage;
+#endif
+   return 0;
+}
+
+static rtos_u32 rtosint_pool_stats(rtos_u32 pool, rtos_pool_usage *usage)
+{
+#ifdef RTOS_BUFFER_STATS
+   if (pool < NBR_BUFFER_POOLS)
    {
-      /* No message in inbox! */
-      /* I see no use of calling receivelist_insert_pcb... */
-      //receivelist_insert_pcb(current_pcb);
-      current_pcb->process_state = PROCESS_STATE_RECEIVE;
-      current_pcb->receive_from = inbox;
+      usage->buffer_size = buffer_sizes[pool];
+      SPIN_LOCK(&alloc_lock);
+      usage->nbr_buffers = pool_stats[pool].nbr_buffers;
+      usage->nbr_free = pool_stats[pool].nbr_buffers -
+         pool_stats[pool].nbr_used;
+      usage->peak_used = pool_stats[pool].peak_used;
+      usage->alloc_failures = pool_stats[pool].alloc_failures;
+      usage->kernel_pool_left = permanent_data_ptr < ARCH_KERNEL_POOL_END ?
+         ARCH_KERNEL_POOL_END - permanent_data_ptr : 0;
+      SPIN_UNLOCK(&alloc_lock);
+      return 1;
+   }
+#else
+   (void) pool;
+   (void) usage;
+#endif
+   return 0;
+}
 
-      /* Reschedule after all active exceptions. */
-      arch_trigger_pendsv();
-      return 0;
+static rtos_u32 rtosint_buffers_held(rtos_u32 pid)
+{
+#ifdef RTOS_BUFFER_STATS
+   if (pid < next_pid)
+   {
+      return pid_pcb_map[pid]->buffers_held;
    }
+#else
+   (void) pid;
+#endif
+   return 0;
 }
 
-static void rtosint_dispose(rtos_address buffer_address)
+static rtos_address rtosint_receive(rtos_u32 inbox)
 {
-   BufferHeader *buffer_header = ((BufferHeader *)(buffer_address - BUFFER_HEADER_SIZE));
+   kernel_assert(inbox < PCB_NBR_INBOXES);
 
-   buffer_header->next = available_list;
-   available_list = buffer_header;
+   return receive_from_inboxes(INBOX_BIT(inbox), 0, 0, RTOS_WAIT_FOREVER);
 }
 
-static void rtosint_tick()
+static rtos_address rtosint_receive_any(rtos_u32 inbox_mask,
+                                        rtos_u32 *received_inbox)
 {
-   PCB *ready_pcb = 0;
-   int do_schedule = 0;
+   kernel_assert(INBOX_MASK_VALID(inbox_mask));
 
-   test_lists();
+   return receive_from_inboxes(inbox_mask, received_inbox, 0,
+                               RTOS_WAIT_FOREVER);
+}
 
-   /* TODO: Handle timeout wrap-around problem below.
-      Move appropriate processes from the delay list to the ready list. */
+static rtos_address rtosint_receive_timeout(rtos_u32 inbox,
+                                            rtos_u32 nbr_ticks)
+{
+   kernel_assert(inbox < PCB_NBR_INBOXES);
 
-   /* The checking and manipulation of the list constitues a critical
-      section. */
-   INTERRUPT_DISABLE;
-   current_tick++;
+   return receive_from_inboxes(INBOX_BIT(inbox), 0, 0, nbr_ticks);
+}
 
-   kernel_assert(delay_pcbs->next != delay_pcbs);
+static rtos_address rtosint_receive_any_timeout(rtos_u32 inbox_mask,
+                                                rtos_u32 *received_inbox,
+                                                rtos_u32 nbr_ticks)
+{
+   kernel_assert(INBOX_MASK_VALID(inbox_mask));
 
-   int nbr_delay_pcbs = 0;
-   PCB *iter = delay_pcbs;
-   for (;iter != 0 && nbr_delay_pcbs < 10;iter = iter->next,nbr_delay_pcbs++);
+   return receive_from_inboxes(inbox_mask, received_inbox, 0, nbr_ticks);
+}
 
-   while (delay_pcbs != 0 && delay_pcbs->delay_until <= current_tick)
-   {
-      /* Take out the first element of the list (earliest timeout). */
-      ready_pcb = delay_pcbs;
-      delay_pcbs = delay_pcbs->next;
-      //INTERRUPT_ENABLE;
+static rtos_u32 rtosint_inbox_count(rtos_u32 inbox)
+{
+   rtos_u32 count = 0;
 
-      /* The PCB pointed out by ready_pcb is not available to anyone else now
-	 so we can manipulate it at will. */
-      ready_pcb->process_state = PROCESS_STATE_READY;
-      readylist_insert_pcb(ready_pcb);
-      if (ready_pcb->priority < current_pcb->priority)
-      {
-        kernel_assert(current_pcb->next != current_pcb);
-        do_schedule = 1;
-      }
+   kernel_assert(inbox < PCB_NBR_INBOXES);
 
-      /* Enter critical section for next list manipulation. */
-      //INTERRUPT_DISABLE;
-   }
+   SPIN_LOCK(&current_pcb->inbox_lock);
+   count = current_pcb->inbox_count[inbox];
+   SPIN_UNLOCK(&current_pcb->inbox_lock);
 
-   INTERRUPT_ENABLE;
+   return count;
+}
 
-   if (do_schedule)
-   {
-     readylist_insert_pcb(current_pcb);
+static void rtosint_dispose(rtos_address buffer_address)
+{
+   buffer_dispose(buffer_address, current_pcb);
+}
 
-     /* Schedule a context switch to take place after all active exceptions.
-        TODO: 'arch_trigger_pendsv' should have a better name, as it is a
-        Cortex-M3 exception name. */
-     arch_trigger_pendsv();
+/******************************************************************************
+ * Function: buffer_dispose
+ *
+ * Disposes a reference to a buffer like rtosint_dispose, and counts it as
+ * given up by 'holder', unless that is 0 for an interrupt handler.
+ */
+static void buffer_dispose(rtos_address buffer_address, PCB *holder)
+{
+   BufferHeader *buffer_header = ((BufferHeader *)(buffer_address - BUFFER_HEADER_SIZE));
+
+   kernel_assert(buffer_header->magic == BUFFER_HEADER_MAGIC);
+   kernel_assert(buffer_header->refcount != 0);
+   kernel_assert(buffer_header->pool < NBR_BUFFER_POOLS);
+   TRACE(RTOS_TRACE_DISPOSE, HOLDER_PID(holder), buffer_header->pool);
+
+   /* Return the buffer to the free-list of the pool it was taken from when
+      the last reference to it is disposed, unless it has been written
+      beyond its end. */
+   SPIN_LOCK(&alloc_lock);
+#ifdef RTOS_BUFFER_STATS
+   if (holder != 0)
+   {
+      holder->buffers_held--;
+   }
+#else
+   (void) holder;
+#endif
+   if (--buffer_header->refcount == 0)
+   {
+      kernel_assert(BUFFER_TRAILER(buffer_header)->magic ==
+                    BUFFER_TRAILER_MAGIC);
+      buffer_header->next = available_lists[buffer_header->pool];
+      available_lists[buffer_header->pool] = buffer_header;
+#ifdef RTOS_BUFFER_STATS
+      pool_stats[buffer_header->pool].nbr_used--;
+#endif
    }
+   SPIN_UNLOCK(&alloc_lock);
+}
 
-   test_lists();
+static void rtosint_tick()
+{
+   KERNEL_LOCK();
+   ticks_advance(1);
+#if RTOS_TIME_SLICE > 0
+   time_slice_tick();
+#endif
+   KERNEL_UNLOCK();
 }
 
 
 static void rtosint_delay(rtos_u32 nbr_ticks)
 {
-   test_lists();
+   TRACE(RTOS_TRACE_DELAY, current_pcb->pid, nbr_ticks);
 #if 1
+   KERNEL_LOCK();
+   current_pcb->process_state = PROCESS_STATE_DELAY;
    delaylist_insert_pcb(current_pcb, nbr_ticks);
+   KERNEL_UNLOCK();
 
    /* Schedule a context switch to take place after all active exceptions.
       TODO: 'arch_trigger_pendsv' should have a better name, as it is a
       Cortex-M3 exception name. */
    arch_trigger_pendsv();
 #endif
-   test_lists();
 }
 
 
 static void rtosint_wait_psem()
 {
-   if (current_pcb->psem_value == 0)
-   {
-      current_pcb->process_state = PROCESS_STATE_PSEM;
-      arch_trigger_pendsv();
-   }
-   else
-   {
-      current_pcb->psem_value--;
-   }
+   psem_wait(RTOS_WAIT_FOREVER);
 }
 
 
-static void rtosint_signal_psem(rtos_u32 pid)
+static rtos_u32 rtosint_wait_psem_timeout(rtos_u32 nbr_ticks)
+{
+   return psem_wait(nbr_ticks);
+}
+
+
+static void rtosint_signal_psem(rtos_u32 pid)
 {
    PCB *signal_pcb = pid_pcb_map[pid];
 
-   if (signal_pcb->process_state == PROCESS_STATE_PSEM)
+   KERNEL_LOCK();
+   if (psem_signal(signal_pcb) && preempts_current(signal_pcb))
    {
-      signal_pcb->process_state = PROCESS_STATE_READY;
-      readylist_insert_pcb(signal_pcb);
+      arch_trigger_pendsv();
+   }
+   KERNEL_UNLOCK();
+}
 
-      if (signal_pcb->priority < current_pcb->priority)
-      {
-	 current_pcb->process_state = PROCESS_STATE_READY;
-	 readylist_insert_pcb(current_pcb);
-	 arch_trigger_pendsv();
-      }
+
+/******************************************************************************
+ * Function: psem_signal
+ *
+ * Signals the psem of the supplied process. A process that waits for it is
+ * made ready, otherwise the psem is counted up. Returns non-zero if the
+ * process was made ready, which the caller checks for preemption.
+ * Interrupts must be disabled, and with several cores the kernel lock must
+ * be held.
+ */
+static int psem_signal(PCB *pcb)
+{
+   TRACE(RTOS_TRACE_PSEM_SIGNAL, pcb->pid,
+         pcb->process_state == PROCESS_STATE_PSEM);
+
+   if (pcb->process_state != PROCESS_STATE_PSEM)
+   {
+      pcb->psem_value++;
+      return 0;
    }
-   else
+
+   /* End a timed wait before its timeout. */
+   if (pcb->delay_link != 0)
    {
-      signal_pcb->psem_value++;
+      delaylist_remove_pcb(pcb);
    }
+   arch_store_retval(1, pcb);
+   pcb->process_state = PROCESS_STATE_READY;
+   readylist_insert_pcb(pcb);
+   return 1;
 }
 
 
@@ -405,259 +1194,2342 @@ static rtos_u32 rtosint_current_pid()
    return current_pcb->pid;
 }
 
-/******************************************************************************
- * Function: readylist_insert_pcb
- *
- * Called to put the supplied PCB in the readylist. The PCB is sorted into the
- * list such that it is placed AFTER all PCBs with the same or higher
- * priority. That way, when picking processes from the head of the list, a
- * round-robin scheduling scheme within priorities is implemented.
- */
-static void readylist_insert_pcb(PCB *pcb)
+
+static void rtosint_migrate(rtos_u32 core)
 {
-   INTERRUPT_DISABLE;
-   test_lists();
+   kernel_assert(core < RTOS_NBR_CORES);
 
-   pcb->process_state = PROCESS_STATE_READY;
-   if (ready_pcbs == 0)
+   /* The process stays RUNNING until the context switch, where
+      rtos_reschedule_hook puts it in the readylist of its new core. */
+   if (core != ARCH_CORE_ID())
    {
-      pcb->next = 0;
-      ready_pcbs = pcb;
-      test_lists();
+      KERNEL_LOCK();
+      current_pcb->core = core;
+      KERNEL_UNLOCK();
+      arch_trigger_pendsv();
    }
-   else if (ready_pcbs->priority > pcb->priority)
+}
+
+
+static rtos_u32 rtosint_current_core(void)
+{
+   return ARCH_CORE_ID();
+}
+
+
+static void rtosint_mutex_lock(rtos_u32 mutex_id)
+{
+   Mutex *mutex = 0;
+   PCB *owner = 0;
+   rtos_u32 length = 0;
+
+   kernel_assert(mutex_id < next_mutex_id);
+   mutex = mutex_map[mutex_id];
+   KERNEL_LOCK();
+   owner = mutex->owner;
+
+   if (owner == 0)
    {
-      /* First PCB has lower priority than pcb. */
-      pcb->next = ready_pcbs;
-      ready_pcbs = pcb;
-      kernel_assert(pcb->next != pcb);
-      test_lists();
+      TRACE(RTOS_TRACE_MUTEX_LOCK, current_pcb->pid, 0xFFFF);
+      mutex->owner = current_pcb;
+      mutex->next_held = current_pcb->mutexes_held;
+      current_pcb->mutexes_held = mutex;
+      KERNEL_UNLOCK();
+      return;
    }
-   else if (ready_pcbs->priority <= pcb->priority &&
-	    ready_pcbs->next != 0)
+
+   /* Mutexes are not recursive. */
+   kernel_assert(owner != current_pcb);
+   TRACE(RTOS_TRACE_MUTEX_LOCK, current_pcb->pid, owner->pid);
+
+   current_pcb->process_state = PROCESS_STATE_MUTEX;
+   current_pcb->mutex_wait = mutex;
+   mutex_waiters_insert(mutex, current_pcb);
+
+   /* Let the owner inherit the priority of the current process. If the
+      owner itself waits for a mutex, the priority is passed on along the
+      chain of owners. */
+   while (owner->priority > current_pcb->priority)
    {
-      /* First PCB has same or higher prio and is not alone. */
-      PCB *iter = ready_pcbs;
+      kernel_assert(++length <= next_pid);
+      process_set_priority(owner, current_pcb->priority);
+      if (owner->process_state != PROCESS_STATE_MUTEX)
+      {
+         break;
+      }
+      owner = owner->mutex_wait->owner;
+   }
+   (void) length;
+   KERNEL_UNLOCK();
 
-      /* Check next PCBs in a loop. */
-      while (iter->next != 0 && iter->next->priority <= pcb->priority)
+   arch_trigger_pendsv();
+}
+
+
+static void rtosint_mutex_unlock(rtos_u32 mutex_id)
+{
+   Mutex *mutex = 0;
+   Mutex **held = 0;
+   PCB *waiter = 0;
+
+   kernel_assert(mutex_id < next_mutex_id);
+   mutex = mutex_map[mutex_id];
+   KERNEL_LOCK();
+   kernel_assert(mutex->owner == current_pcb);
+
+   for (held = &current_pcb->mutexes_held; *held != mutex;
+        held = &(*held)->next_held)
+   {
+      kernel_assert(*held != 0);
+   }
+   *held = mutex->next_held;
+   mutex->next_held = 0;
+
+   waiter = mutex->waiters;
+   if (waiter == 0)
+   {
+      TRACE(RTOS_TRACE_MUTEX_UNLOCK, current_pcb->pid, 0xFFFF);
+      mutex->owner = 0;
+   }
+   else
+   {
+      /* Hand the mutex over to the first waiter, so that the current
+         process cannot take it back before the waiter gets to run. The
+         other waiters do not have higher priority than the new owner, so
+         there is nothing for it to inherit. */
+      TRACE(RTOS_TRACE_MUTEX_UNLOCK, current_pcb->pid, waiter->pid);
+      mutex->waiters = waiter->next;
+      mutex->owner = waiter;
+      mutex->next_held = waiter->mutexes_held;
+      waiter->mutexes_held = mutex;
+      waiter->mutex_wait = 0;
+      readylist_insert_pcb(waiter);
+   }
+
+   process_set_priority(current_pcb, mutex_inherited_priority(current_pcb));
+
+   if (ready_bitmap[ARCH_CORE_ID()] != 0 &&
+       arch_clz(ready_bitmap[ARCH_CORE_ID()]) < current_pcb->priority)
+   {
+      arch_trigger_pendsv();
+   }
+   KERNEL_UNLOCK();
+}
+
+static rtos_u32 rtosint_event_wait(rtos_u32 group_id, rtos_u32 mask,
+                                   rtos_u32 options)
+{
+   EventGroup *group = 0;
+   rtos_u32 flags = 0;
+
+   kernel_assert(group_id < next_event_group_id);
+   kernel_assert(mask != 0);
+   group = event_group_map[group_id];
+   KERNEL_LOCK();
+   flags = group->flags;
+
+   if (EVENT_SATISFIED(flags, mask, options))
+   {
+      TRACE(RTOS_TRACE_EVENT_WAIT, current_pcb->pid, 0);
+      if ((options & RTOS_EVENT_CLEAR) != 0)
       {
-        kernel_assert(iter->next != iter);
-        iter = iter->next;
+         group->flags &= ~mask;
       }
-      if (iter->next == 0)
+      KERNEL_UNLOCK();
+      return flags;
+   }
+
+   /* Wait last in the list of waiters. The flags are returned by
+      rtosint_event_set, via arch_store_retval. */
+   TRACE(RTOS_TRACE_EVENT_WAIT, current_pcb->pid, 1);
+   current_pcb->process_state = PROCESS_STATE_EVENT;
+   current_pcb->event_mask = mask;
+   current_pcb->event_options = options;
+   current_pcb->next = 0;
+   if (group->waiters == 0)
+   {
+      group->waiters = current_pcb;
+   }
+   else
+   {
+      group->waiters_tail->next = current_pcb;
+   }
+   group->waiters_tail = current_pcb;
+   KERNEL_UNLOCK();
+
+   arch_trigger_pendsv();
+   return 0;
+}
+
+
+static void rtosint_event_set(rtos_u32 group_id, rtos_u32 flags)
+{
+   EventGroup *group = 0;
+   PCB **link = 0;
+   PCB *previous = 0;
+   PCB *pcb = 0;
+   rtos_u32 clear = 0;
+   rtos_u32 nbr_woken = 0;
+   int do_schedule = 0;
+
+   kernel_assert(group_id < next_event_group_id);
+   group = event_group_map[group_id];
+   KERNEL_LOCK();
+   group->flags |= flags;
+
+   /* Wake every satisfied waiter in one pass. The bits that they clear
+      are cleared afterwards, so that all of them are checked against the
+      same flags. */
+   link = &group->waiters;
+   while (*link != 0)
+   {
+      pcb = *link;
+      if (EVENT_SATISFIED(group->flags, pcb->event_mask, pcb->event_options))
       {
-	 pcb->next = 0;
-	 iter->next = pcb;
-         test_lists();
+         *link = pcb->next;
+         if (group->waiters_tail == pcb)
+         {
+            group->waiters_tail = previous;
+         }
+         if ((pcb->event_options & RTOS_EVENT_CLEAR) != 0)
+         {
+            clear |= pcb->event_mask;
+         }
+
+         arch_store_retval(group->flags, pcb);
+         readylist_insert_pcb(pcb);
+         nbr_woken++;
+         if (preempts_current(pcb))
+         {
+            do_schedule = 1;
+         }
       }
       else
       {
-	 pcb->next = iter->next;
-	 iter->next = pcb;
-         kernel_assert(pcb->next != pcb);
-         test_lists();
+         previous = pcb;
+         link = &pcb->next;
       }
    }
-   else if (ready_pcbs->next == 0)
+   group->flags &= ~clear;
+   TRACE(RTOS_TRACE_EVENT_SET, current_pcb->pid, nbr_woken);
+   KERNEL_UNLOCK();
+
+   if (do_schedule)
    {
-      /* First PCB has same or higher priority than pcb and is alone. */
-      pcb->next = 0;
-      ready_pcbs->next = pcb;
+      arch_trigger_pendsv();
+   }
+}
+
+
+static rtos_u32 rtosint_event_clear(rtos_u32 group_id, rtos_u32 flags)
+{
+   EventGroup *group = 0;
+   rtos_u32 previous_flags = 0;
+
+   kernel_assert(group_id < next_event_group_id);
+   group = event_group_map[group_id];
+   KERNEL_LOCK();
+   previous_flags = group->flags;
+   group->flags &= ~flags;
+   KERNEL_UNLOCK();
+
+   return previous_flags;
+}
+
+/******************************************************************************
+ * Function: psem_wait
+ *
+ * Common part of the psem wait syscalls. Takes the psem of the current
+ * process and returns 1 if it has been signaled. Otherwise the process is
+ * put in PSEM, and also in the delaylist unless 'nbr_ticks' is
+ * RTOS_WAIT_FOREVER. It then returns 1 from rtosint_signal_psem or 0 from
+ * timerwheel_advance, via arch_store_retval, whichever comes first. Returns
+ * 0 at once if 'nbr_ticks' is 0.
+ */
+static rtos_u32 psem_wait(rtos_u32 nbr_ticks)
+{
+   rtos_u32 signaled = 0;
+
+   KERNEL_LOCK();
+   TRACE(RTOS_TRACE_PSEM_WAIT, current_pcb->pid,
+         current_pcb->psem_value == 0 && nbr_ticks != 0);
+
+   if (current_pcb->psem_value != 0)
+   {
+      current_pcb->psem_value--;
+      signaled = 1;
+   }
+   else if (nbr_ticks != 0)
+   {
+      current_pcb->process_state = PROCESS_STATE_PSEM;
+      if (nbr_ticks != RTOS_WAIT_FOREVER)
+      {
+         delaylist_insert_pcb(current_pcb, nbr_ticks);
+      }
+      arch_trigger_pendsv();
    }
-   test_lists();
+   KERNEL_UNLOCK();
 
-   INTERRUPT_ENABLE;
+   return signaled;
 }
 
 
 /******************************************************************************
- * Function: receivelist_insert_pcb
+ * Function: receive_from_inboxes
  *
- * Called to put the supplied PCB in the receivelist. The PCB is sorted into the
- * list such that it is placed AFTER all PCBs with the same or higher
- * priority. That way, when looking for processes to receive messages, high-
- * priority processes are found faster, improving overall performance.
+ * Common part of the receive syscalls. Returns the first message in the
+ * lowest-numbered inbox of the current process that is set in 'inbox_mask'.
+ * If all those inboxes are empty, the current process is put in RECEIVE, and
+ * also in the delaylist unless 'nbr_ticks' is RTOS_WAIT_FOREVER, and a
+ * context switch is scheduled. The message is then returned by rtosint_send,
+ * via arch_store_retval, when it arrives, or 0 by timerwheel_advance at the
+ * timeout. If 'nbr_ticks' is 0, 0 is returned at once. The inbox the message
+ * was taken from is stored in 'received_inbox', unless it is 0. If
+ * 'received_buffer' is not 0, a message that arrives while waiting is stored
+ * there instead, and 1 is returned, as rtosint_receive_all returns the
+ * number of messages.
+ */
+static rtos_address receive_from_inboxes(rtos_u32 inbox_mask,
+                                         rtos_u32 *received_inbox,
+                                         rtos_address *received_buffer,
+                                         rtos_u32 nbr_ticks)
+{
+   BufferHeader *received = 0;
+
+   SPIN_LOCK(&current_pcb->inbox_lock);
+   received = inbox_take(current_pcb, inbox_mask, received_inbox);
+   if (received == 0 && nbr_ticks != 0)
+   {
+#if RTOS_NBR_CORES > 1
+      /* Waiting takes the kernel lock, which comes first, so a message may
+         arrive while the inbox lock is released. */
+      SPIN_UNLOCK(&current_pcb->inbox_lock);
+      KERNEL_LOCK();
+      SPIN_LOCK(&current_pcb->inbox_lock);
+      received = inbox_take(current_pcb, inbox_mask, received_inbox);
+      if (received == 0)
+#endif
+      {
+         /* No message in any of the inboxes! */
+         TRACE(RTOS_TRACE_RECEIVE_WAIT, current_pcb->pid, inbox_mask);
+         current_pcb->process_state = PROCESS_STATE_RECEIVE;
+         current_pcb->receive_mask = inbox_mask;
+         current_pcb->receive_inbox = received_inbox;
+         current_pcb->receive_buffer = received_buffer;
+         if (nbr_ticks != RTOS_WAIT_FOREVER)
+         {
+            delaylist_insert_pcb(current_pcb, nbr_ticks);
+         }
+
+         /* Reschedule after all active exceptions. */
+         arch_trigger_pendsv();
+      }
+      SPIN_UNLOCK(&current_pcb->inbox_lock);
+      KERNEL_UNLOCK();
+   }
+   else
+   {
+      SPIN_UNLOCK(&current_pcb->inbox_lock);
+   }
+
+   return received == 0 ? 0 : ((rtos_address) received) + BUFFER_HEADER_SIZE;
+}
+
+
+/******************************************************************************
+ * Function: inbox_take
  *
- * FIXME: This is a duplicate of readylist_insert_pcb.
+ * Takes out the first message in the lowest-numbered inbox of the supplied
+ * PCB that is set in 'inbox_mask' and stores the inbox in 'received_inbox',
+ * unless it is 0. Returns 0 if all those inboxes are empty. The inbox lock
+ * of the PCB must be held.
  */
-static void receivelist_insert_pcb(PCB *pcb)
+static BufferHeader *inbox_take(PCB *pcb, rtos_u32 inbox_mask,
+                                rtos_u32 *received_inbox)
 {
-   test_lists();
-   if (receive_pcbs == 0)
+   rtos_u32 inbox = 0;
+
+   for (inbox = 0; inbox < PCB_NBR_INBOXES; inbox++)
    {
-      pcb->next = 0;
-      receive_pcbs = pcb;
+      if ((inbox_mask & INBOX_BIT(inbox)) != 0 && pcb->inbox[inbox] != 0)
+      {
+         /* Message waiting in inbox. */
+         TRACE(RTOS_TRACE_RECEIVE, pcb->pid, inbox);
+         if (received_inbox != 0)
+         {
+            *received_inbox = inbox;
+         }
+         return inbox_remove_first(pcb, inbox);
+      }
    }
-   else if (receive_pcbs->priority > pcb->priority)
+
+   return 0;
+}
+
+
+/******************************************************************************
+ * Function: message_deliver
+ *
+ * Delivers 'nbr_buffers' messages, at least one, to an inbox of the supplied
+ * PCB, in the order they are given. If the process waits for a message in
+ * that inbox, it is made ready and returns from its receive call with the
+ * first message. The others are put last in the inbox. Does not change the
+ * reference counts of the buffers, except that a message that finds no inbox
+ * node, as the kernel pool is used up, is not delivered and its reference is
+ * disposed.
+ *
+ * Returns non-zero if the destination process was made ready and has higher
+ * priority than the current process, i.e. if a context switch is needed.
+ */
+static int message_deliver(PCB *dest_pcb, rtos_u32 dest_inbox,
+                           const rtos_address *buffers,
+                           rtos_u32 nbr_buffers)
+{
+   BufferHeader *buffer_header = 0;
+   MessageRef *ref = 0;
+   rtos_u32 index = 0;
+   int do_schedule = 0;
+#if RTOS_NBR_CORES > 1
+   int kernel_locked = 0;
+#endif
+
+   kernel_assert(dest_inbox < PCB_NBR_INBOXES);
+
+   SPIN_LOCK(&dest_pcb->inbox_lock);
+#if RTOS_NBR_CORES > 1
+   if (RECEIVE_WAITING(dest_pcb, dest_inbox))
    {
-      /* First PCB has lower priority than pcb. */
-      pcb->next = receive_pcbs;
-      receive_pcbs = pcb;
+      /* Waking the receiver takes the kernel lock, which comes first. The
+         receiver may time out while the inbox lock is released, so it is
+         checked again. A process not waiting cannot start to wait while the
+         inbox lock is held. */
+      SPIN_UNLOCK(&dest_pcb->inbox_lock);
+      KERNEL_LOCK();
+      SPIN_LOCK(&dest_pcb->inbox_lock);
+      kernel_locked = 1;
    }
-   else if (receive_pcbs->priority <= pcb->priority &&
-	    receive_pcbs->next != 0)
+#endif
+
+   if (RECEIVE_WAITING(dest_pcb, dest_inbox))
    {
-      /* First PCB has same or higher prio and is not alone. */
-      PCB *iter = receive_pcbs;
+      /* Destination process is in RECEIVE on this inbox, so the inbox is
+         empty. It shall return from the receive call with the first
+         message. */
+      TRACE(RTOS_TRACE_SEND, current_pcb->pid,
+            dest_pcb->pid | (dest_inbox << 8));
+      kernel_assert(((BufferHeader *) (buffers[0] - BUFFER_HEADER_SIZE))->magic
+                    == BUFFER_HEADER_MAGIC);
+      if (dest_pcb->receive_inbox != 0)
+      {
+         *dest_pcb->receive_inbox = dest_inbox;
+      }
 
-      /* Check next PCBs in a loop. */
-      while (iter->next != 0 && iter->next->priority <= pcb->priority)
+      /* End a timed receive before its timeout. */
+      if (dest_pcb->delay_link != 0)
       {
-	 iter = iter->next;
+         delaylist_remove_pcb(dest_pcb);
+      }
+      dest_pcb->process_state = PROCESS_STATE_READY;
+      readylist_insert_pcb(dest_pcb);
+#ifdef RTOS_BUFFER_STATS
+      SPIN_LOCK(&alloc_lock);
+      buffer_owner_set((BufferHeader *) (buffers[0] - BUFFER_HEADER_SIZE),
+                       dest_pcb);
+      SPIN_UNLOCK(&alloc_lock);
+#endif
+      if (dest_pcb->receive_buffer != 0)
+      {
+         *dest_pcb->receive_buffer = buffers[0];
+         arch_store_retval(1, dest_pcb);
+      }
+      else
+      {
+         arch_store_retval(buffers[0], dest_pcb);
       }
+      TRACE(RTOS_TRACE_RECEIVE, dest_pcb->pid, dest_inbox);
 
-      /* TODO: Optimize like in delaylist_insert_pcb. */
-      if (iter->next == 0)
+      do_schedule = preempts_current(dest_pcb);
+      index = 1;
+   }
+
+   /* Put the remaining messages last in the inbox. No need to schedule for
+      them, as the destination process stays where it is. */
+   for (; index < nbr_buffers; index++)
+   {
+      TRACE(RTOS_TRACE_SEND, current_pcb->pid,
+            dest_pcb->pid | (dest_inbox << 8));
+      buffer_header = (BufferHeader *) (buffers[index] - BUFFER_HEADER_SIZE);
+      kernel_assert(buffer_header->magic == BUFFER_HEADER_MAGIC);
+      ref = message_ref_get(buffer_header);
+      if (ref != 0)
       {
-	 pcb->next = 0;
-	 iter->next = pcb;
+         inbox_append(dest_pcb, dest_inbox, ref);
       }
       else
       {
-	 pcb->next = iter->next;
-	 iter->next = pcb;
+         buffer_dispose(buffers[index], 0);
       }
    }
-   else if (receive_pcbs->next == 0)
+
+   SPIN_UNLOCK(&dest_pcb->inbox_lock);
+#if RTOS_NBR_CORES > 1
+   if (kernel_locked)
    {
-      /* First PCB has same or higher priority than pcb and is alone. */
-      pcb->next = 0;
-      receive_pcbs->next = pcb;
+      KERNEL_UNLOCK();
    }
-   test_lists();
+#endif
+   return do_schedule;
 }
 
+
 /******************************************************************************
- * Function: delaylist_insert_pcb
- *
- * Called to put the supplied PCB in the delaylist. The PCB is sorted into the
- * list such that it is placed AFTER all PCBs with the same or higher
- * priority. That way, when looking for processes to receive messages, high-
- * priority processes are found faster, improving overall performance.
+ * Function: inbox_append
  *
- * FIXME: This is a duplicate of readylist_insert_pcb.
+ * Puts a message last in an inbox of the supplied PCB. Runs in constant time
+ * by keeping a pointer to the last message of each inbox.
  */
-static void delaylist_insert_pcb(PCB *pcb, rtos_u32 nbr_ticks)
+static void inbox_append(PCB *pcb, rtos_u32 inbox, MessageRef *ref)
 {
-   INTERRUPT_DISABLE;
-   test_lists();
-   pcb->delay_until = current_tick + nbr_ticks;
-   pcb->process_state = PROCESS_STATE_DELAY;
-   if (delay_pcbs == 0)
+   rtos_u32 priority = ref->buffer->priority;
+   MessageRef **tails = pcb->inbox_tail[inbox];
+   MessageRef *prev = tails[priority];
+   rtos_u32 higher = 0;
+
+   /* The message goes after the last one of its priority, or if there is
+      none, after the last one of the nearest higher priority. */
+   if (prev == 0)
    {
-      /* No PCBs in the list. */
-      pcb->next = 0;
-      delay_pcbs = pcb;
-   }
-   else if (delay_pcbs->delay_until > pcb->delay_until)
-   {
-     /* First PCB has longer timeout. */
-     pcb->next = delay_pcbs;
-     delay_pcbs = pcb;
-     kernel_assert(delay_pcbs->next != delay_pcbs);
-   }
-   else if (delay_pcbs->next != 0)
-   {
-      /* First PCB has same or shorter timeout and is not alone. */
-      PCB *iter = delay_pcbs;
-
-      /* Check next PCBs until next has longer timeout. */
-      while (iter->next != 0 && iter->next->delay_until <= pcb->delay_until)
+      higher = pcb->inbox_priorities[inbox] & ~((2u << priority) - 1);
+      if (higher != 0)
       {
-	 iter = iter->next;
+         prev = tails[31 - arch_clz(higher & (~higher + 1))];
       }
+      pcb->inbox_priorities[inbox] |= 1u << priority;
+   }
 
-      pcb->next = iter->next;
-      iter->next = pcb;
-      kernel_assert(pcb->next != pcb);
+   if (prev == 0)
+   {
+      ref->next = pcb->inbox[inbox];
+      pcb->inbox[inbox] = ref;
    }
    else
    {
-      /* First PCB has same or shorter timeout and is alone. */
-      pcb->next = 0;
-      delay_pcbs->next = pcb;
+      ref->next = prev->next;
+      prev->next = ref;
    }
-   test_lists();
-   INTERRUPT_ENABLE;
+   tails[priority] = ref;
+   pcb->inbox_count[inbox]++;
 }
 
 
 /******************************************************************************
- * Function: kernel_alloc_permanent
- *
- * Permanently allocates memory with the specified size and alignment.
+ * Function: inbox_remove_first
  *
- * TODO:
- * - Use DISABLE_SAVE/ENABLE_SAVED here.
+ * Takes out the first message of a non-empty inbox of the supplied PCB.
  */
-static rtos_address kernel_alloc_permanent(rtos_u32 size, rtos_u8 alignment)
+static BufferHeader *inbox_remove_first(PCB *pcb, rtos_u32 inbox)
 {
-   rtos_address data_block = 0;
+   MessageRef *ref = pcb->inbox[inbox];
+   BufferHeader *buffer_header = ref->buffer;
+   rtos_u32 priority = buffer_header->priority;
 
-   /* Move permanent_data_ptr up to the next correctly aligned address. */
-   if ((permanent_data_ptr & (alignment - 1)) != 0)
+   pcb->inbox[inbox] = ref->next;
+   if (pcb->inbox_tail[inbox][priority] == ref)
    {
-      permanent_data_ptr += alignment;
-      permanent_data_ptr &= ~(alignment - 1);
+      pcb->inbox_tail[inbox][priority] = 0;
+      pcb->inbox_priorities[inbox] &= ~(1u << priority);
    }
+   pcb->inbox_count[inbox]--;
+   SPIN_LOCK(&alloc_lock);
+#ifdef RTOS_BUFFER_STATS
+   buffer_owner_set(buffer_header, pcb);
+#endif
+   message_ref_free(ref);
+   SPIN_UNLOCK(&alloc_lock);
 
-   data_block = permanent_data_ptr;
-   permanent_data_ptr += size;
-
-   return data_block;
+   return buffer_header;
 }
 
+
 /******************************************************************************
- * Function:  rtos_context_switch_hook
+ * Function: inbox_detach
  *
- * Called to do administration before context switch.
- * Updates new_pcb before context switch is performed by arch specific
- * assembly code.
+ * Takes out the first messages of an inbox of the supplied PCB, all of them
+ * unless there are more than 'max_messages', and returns their number. They
+ * are left linked through 'next' in the order they were in, starting at
+ * 'detached', and their inbox nodes must be released by the caller. A whole
+ * inbox is detached in constant time, otherwise the time is linear in
+ * 'max_messages'.
  */
-void rtos_reschedule_hook()
+static rtos_u32 inbox_detach(PCB *pcb, rtos_u32 inbox, rtos_u32 max_messages,
+                             MessageRef **detached)
 {
-   new_pcb = ready_pcbs;
-   ready_pcbs = ready_pcbs->next;
-   new_pcb->process_state = PROCESS_STATE_RUNNING;
+   MessageRef **tails = pcb->inbox_tail[inbox];
+   MessageRef *last = pcb->inbox[inbox];
+   rtos_u32 count = pcb->inbox_count[inbox];
+   rtos_u32 priority = 0;
+   rtos_u32 index = 0;
+
+   *detached = last;
+   if (count <= max_messages)
+   {
+      pcb->inbox[inbox] = 0;
+      for (priority = 0; priority < RTOS_MESSAGE_PRIORITIES; priority++)
+      {
+         tails[priority] = 0;
+      }
+      pcb->inbox_priorities[inbox] = 0;
+      pcb->inbox_count[inbox] = 0;
+      return count;
+   }
+
+   for (index = 1; index < max_messages; index++)
+   {
+      last = last->next;
+   }
+
+   /* The most urgent messages come first, so the detached ones are all
+      those with a higher priority than the last of them, and those with
+      its priority up to it. */
+   priority = last->buffer->priority;
+   for (index = priority + 1; index < RTOS_MESSAGE_PRIORITIES; index++)
+   {
+      tails[index] = 0;
+   }
+   pcb->inbox_priorities[inbox] &= (2u << priority) - 1;
+   if (tails[priority] == last)
+   {
+      tails[priority] = 0;
+      pcb->inbox_priorities[inbox] &= ~(1u << priority);
+   }
+
+   pcb->inbox[inbox] = last->next;
+   last->next = 0;
+   pcb->inbox_count[inbox] -= max_messages;
+   return max_messages;
 }
 
 
 /******************************************************************************
- * Function:   rtos_init
+ * Function: message_ref_get
  *
- * Called from boot code, after BSS and DATA have been initialized.
+ * Returns a free inbox node referring to the supplied buffer: the node of the
+ * buffer itself, unless that one is already in an inbox, or one from the pool
+ * of free nodes, which grows as needed. Returns 0 if the pool is empty and
+ * the kernel pool is used up.
  */
-void rtos_init()
+static MessageRef *message_ref_get(BufferHeader *buffer_header)
 {
-  PCB *pcb_iterator = 0;
+   MessageRef *ref = 0;
+
+   SPIN_LOCK(&alloc_lock);
+   if (!buffer_header->ref_used)
+   {
+      buffer_header->ref_used = 1;
+      ref = &buffer_header->ref;
+   }
+   else if (free_refs != 0)
+   {
+      ref = free_refs;
+      free_refs = ref->next;
+   }
+   else
+   {
+      ref = (MessageRef *)
+         kernel_alloc_permanent(sizeof(MessageRef), sizeof(rtos_address));
+   }
+   if (ref != 0)
+   {
+      ref->buffer = buffer_header;
+   }
+   SPIN_UNLOCK(&alloc_lock);
+
+   return ref;
+}
+
+
+/******************************************************************************
+ * Function: message_ref_free
+ *
+ * Releases an inbox node taken out of an inbox. The allocator lock must be
+ * held.
+ */
+static void message_ref_free(MessageRef *ref)
+{
+   if (ref == &ref->buffer->ref)
+   {
+      ref->buffer->ref_used = 0;
+   }
+   else
+   {
+      ref->next = free_refs;
+      free_refs = ref;
+   }
+}
+
+
+#ifdef RTOS_BUFFER_STATS
+/******************************************************************************
+ * Function: buffer_owner_set
+ *
+ * Makes the supplied PCB, which receives a reference to a buffer in use, the
+ * owner of the buffer, and counts the reference as held by it. The allocator
+ * lock must be held.
+ */
+static void buffer_owner_set(BufferHeader *buffer_header, PCB *pcb)
+{
+   buffer_header->owner = pcb->pid;
+   pcb->buffers_held++;
+}
+#endif
+
+
+/******************************************************************************
+ * Function: readylist_insert_pcb
+ *
+ * Called to put the supplied PCB in the readylist. The PCB is put last in the
+ * FIFO for its priority, i.e. AFTER all PCBs with the same priority. That
+ * way, when picking processes from the head of the FIFOs, a round-robin
+ * scheduling scheme within priorities is implemented. Runs in constant time.
+ * The PCB goes to the readylist of its core, and if it should preempt the
+ * process running on another core, that core is made to reschedule.
+ * Interrupts must be disabled.
+ */
+static void readylist_insert_pcb(PCB *pcb)
+{
+   rtos_u8 priority = pcb->priority;
+   rtos_u32 core = pcb->core;
+
+   pcb->process_state = PROCESS_STATE_READY;
+   pcb->next = 0;
+   if (ready_heads[core][priority] == 0)
+   {
+      /* FIFO is empty, mark the priority level as ready. */
+      ready_heads[core][priority] = pcb;
+      ready_bitmap[core] |= READY_BIT(priority);
+   }
+   else
+   {
+      kernel_assert(ready_tails[core][priority] != pcb);
+      ready_tails[core][priority]->next = pcb;
+   }
+   ready_tails[core][priority] = pcb;
+
+#if RTOS_NBR_CORES > 1
+   /* Before the kernel is started, the cores have no processes. */
+   if (core != ARCH_CORE_ID() && rtos_current_pcbs[core] != 0 &&
+       priority < rtos_current_pcbs[core]->priority)
+   {
+      arch_kick_core(core);
+   }
+#endif
+}
+
+
+/******************************************************************************
+ * Function: readylist_remove_highest
+ *
+ * Takes out the first PCB of the highest-priority non-empty FIFO in the
+ * readylist of 'core'. Runs in constant time. There must be at least one
+ * process in the readylist. Interrupts must be disabled.
+ */
+static PCB *readylist_remove_highest(rtos_u32 core)
+{
+   PCB *pcb = 0;
+   rtos_u32 priority = 0;
+
+   kernel_assert(ready_bitmap[core] != 0);
+
+   priority = arch_clz(ready_bitmap[core]);
+   pcb = ready_heads[core][priority];
+   ready_heads[core][priority] = pcb->next;
+   if (ready_heads[core][priority] == 0)
+   {
+      /* Last PCB with this priority taken out. */
+      ready_bitmap[core] &= ~READY_BIT(priority);
+   }
+
+   pcb->next = 0;
+   return pcb;
+}
+
+
+/******************************************************************************
+ * Function: readylist_remove_pcb
+ *
+ * Takes out the supplied PCB, which must be in the readylist, from the FIFO
+ * of its priority. Runs in time linear in the number of ready processes with
+ * that priority. Interrupts must be disabled.
+ */
+static void readylist_remove_pcb(PCB *pcb)
+{
+   rtos_u8 priority = pcb->priority;
+   rtos_u32 core = pcb->core;
+   PCB **link = &ready_heads[core][priority];
+   PCB *previous = 0;
+
+   while (*link != pcb)
+   {
+      kernel_assert(*link != 0);
+      previous = *link;
+      link = &previous->next;
+   }
+
+   *link = pcb->next;
+   if (ready_tails[core][priority] == pcb)
+   {
+      ready_tails[core][priority] = previous;
+   }
+   if (ready_heads[core][priority] == 0)
+   {
+      ready_bitmap[core] &= ~READY_BIT(priority);
+   }
+   pcb->next = 0;
+}
+
+
+/******************************************************************************
+ * Function: preempts_current
+ *
+ * Returns non-zero if the supplied PCB, just made ready, should preempt the
+ * current process, i.e. if a context switch is needed. A process of another
+ * core preempts the process running there through readylist_insert_pcb.
+ */
+static int preempts_current(PCB *pcb)
+{
+#if RTOS_NBR_CORES > 1
+   if (pcb->core != ARCH_CORE_ID())
+   {
+      return 0;
+   }
+#endif
+   return pcb->priority < current_pcb->priority;
+}
+
+
+/******************************************************************************
+ * Function: mutex_waiters_insert
+ *
+ * Puts the supplied PCB among the waiters of a mutex, after all waiters with
+ * the same or higher priority. Interrupts must be disabled.
+ */
+static void mutex_waiters_insert(Mutex *mutex, PCB *pcb)
+{
+   PCB **link = &mutex->waiters;
+
+   while (*link != 0 && (*link)->priority <= pcb->priority)
+   {
+      link = &(*link)->next;
+   }
+   pcb->next = *link;
+   *link = pcb;
+}
+
+
+/******************************************************************************
+ * Function: mutex_waiters_remove
+ *
+ * Takes out the supplied PCB from the waiters of a mutex. Interrupts must be
+ * disabled.
+ */
+static void mutex_waiters_remove(Mutex *mutex, PCB *pcb)
+{
+   PCB **link = &mutex->waiters;
+
+   while (*link != pcb)
+   {
+      kernel_assert(*link != 0);
+      link = &(*link)->next;
+   }
+   *link = pcb->next;
+   pcb->next = 0;
+}
+
+
+/******************************************************************************
+ * Function: mutex_inherited_priority
+ *
+ * Returns the priority that the supplied process should run with: the
+ * highest of its base priority and the priorities of the first waiters of
+ * the mutexes it owns.
+ */
+static rtos_u8 mutex_inherited_priority(PCB *pcb)
+{
+   rtos_u8 priority = pcb->base_priority;
+   Mutex *mutex = 0;
+
+   for (mutex = pcb->mutexes_held; mutex != 0; mutex = mutex->next_held)
+   {
+      if (mutex->waiters != 0 && mutex->waiters->priority < priority)
+      {
+         priority = mutex->waiters->priority;
+      }
+   }
+   return priority;
+}
+
+
+/******************************************************************************
+ * Function: process_set_priority
+ *
+ * Changes the priority of a process, moving it within the readylist or the
+ * waiters of a mutex, which are ordered by priority. Interrupts must be
+ * disabled.
+ */
+static void process_set_priority(PCB *pcb, rtos_u8 priority)
+{
+   if (pcb->priority == priority)
+   {
+      return;
+   }
+   TRACE(RTOS_TRACE_PRIORITY, pcb->pid, priority);
+
+   switch (pcb->process_state)
+   {
+      case PROCESS_STATE_READY:
+         readylist_remove_pcb(pcb);
+         pcb->priority = priority;
+         readylist_insert_pcb(pcb);
+         break;
+
+      case PROCESS_STATE_MUTEX:
+         mutex_waiters_remove(pcb->mutex_wait, pcb);
+         pcb->priority = priority;
+         mutex_waiters_insert(pcb->mutex_wait, pcb);
+         break;
+
+      default:
+         pcb->priority = priority;
+         break;
+   }
+}
+
+
+/******************************************************************************
+ * Function: receivelist_insert_pcb
+ *
+ * Called to put the supplied PCB in the receivelist. The PCB is sorted into the
+ * list such that it is placed AFTER all PCBs with the same or higher
+ * priority. That way, when looking for processes to receive messages, high-
+ * priority processes are found faster, improving overall performance.
+ *
+ * FIXME: This is a duplicate of readylist_insert_pcb.
+ */
+static void receivelist_insert_pcb(PCB *pcb)
+{
+   if (receive_pcbs == 0)
+   {
+      pcb->next = 0;
+      receive_pcbs = pcb;
+   }
+   else if (receive_pcbs->priority > pcb->priority)
+   {
+      /* First PCB has lower priority than pcb. */
+      pcb->next = receive_pcbs;
+      receive_pcbs = pcb;
+   }
+   else if (receive_pcbs->priority <= pcb->priority &&
+	    receive_pcbs->next != 0)
+   {
+      /* First PCB has same or higher prio and is not alone. */
+      PCB *iter = receive_pcbs;
+
+      /* Check next PCBs in a loop. */
+      while (iter->next != 0 && iter->next->priority <= pcb->priority)
+      {
+	 iter = iter->next;
+      }
+
+      /* TODO: Optimize like in delaylist_insert_pcb. */
+      if (iter->next == 0)
+      {
+	 pcb->next = 0;
+	 iter->next = pcb;
+      }
+      else
+      {
+	 pcb->next = iter->next;
+	 iter->next = pcb;
+      }
+   }
+   else if (receive_pcbs->next == 0)
+   {
+      /* First PCB has same or higher priority than pcb and is alone. */
+      pcb->next = 0;
+      receive_pcbs->next = pcb;
+   }
+}
+
+/******************************************************************************
+ * Function: delaylist_insert_pcb
+ *
+ * Called to put the supplied PCB in the delaylist, i.e. the timer wheel, to
+ * be made ready again 'nbr_ticks' ticks from now. A delay of 0 ticks is
+ * treated as a delay until the next tick. The caller sets the process state:
+ * DELAY, or the state of a timed wait. Runs in constant time. Interrupts
+ * must be disabled.
+ */
+static void delaylist_insert_pcb(PCB *pcb, rtos_u32 nbr_ticks)
+{
+   if (nbr_ticks == 0)
+   {
+      nbr_ticks = 1;
+   }
+
+   pcb->delay_until = current_tick + nbr_ticks;
+   timerwheel_insert(pcb);
+}
+
+
+/******************************************************************************
+ * Function: delaylist_remove_pcb
+ *
+ * Takes out the supplied PCB, which must be in the delaylist, when its timed
+ * wait ends before the timeout. Runs in constant time. Interrupts must be
+ * disabled.
+ */
+static void delaylist_remove_pcb(PCB *pcb)
+{
+   *pcb->delay_link = pcb->next;
+   if (pcb->next != 0)
+   {
+      pcb->next->delay_link = pcb->delay_link;
+   }
+   pcb->next = 0;
+   pcb->delay_link = 0;
+}
+
+
+/******************************************************************************
+ * Function: timerwheel_insert
+ *
+ * Puts the supplied PCB in the slot of the timer wheel that corresponds to
+ * its 'delay_until' tick. The PCB goes to the lowest level whose range
+ * covers the remaining number of ticks. All tick arithmetic is modulo 2^32,
+ * so 'current_tick' may wrap around. Interrupts must be disabled.
+ */
+static void timerwheel_insert(PCB *pcb)
+{
+   rtos_u32 remaining = pcb->delay_until - current_tick;
+   rtos_u32 level = 0;
+   PCB **slot = 0;
+
+   while (level < TIMER_WHEEL_LEVELS - 1 &&
+          remaining >= (1u << (TIMER_WHEEL_BITS * (level + 1))))
+   {
+      level++;
+   }
+
+   slot = &timer_wheel[level][TIMER_WHEEL_INDEX(pcb->delay_until, level)];
+   pcb->next = *slot;
+   if (pcb->next != 0)
+   {
+      pcb->next->delay_link = &pcb->next;
+   }
+   pcb->delay_link = slot;
+   *slot = pcb;
+}
+
+
+/******************************************************************************
+ * Function: timerwheel_advance
+ *
+ * Advances 'current_tick' by one tick. Every time the slot index of a level
+ * wraps around to 0, the next slot of the level above is emptied and its
+ * PCBs are moved down to lower levels (cascading). Then all PCBs in the
+ * current slot of the lowest level, which all time out on this very tick,
+ * are put in the readylist. Interrupts must be disabled.
+ *
+ * Returns non-zero if a process with higher priority than the current
+ * process was made ready.
+ */
+static int timerwheel_advance(void)
+{
+   PCB *iter = 0;
+   PCB *ready_pcb = 0;
+   rtos_u32 level = 0;
+   rtos_u32 index = 0;
+   int do_schedule = 0;
+
+   current_tick++;
+
+   /* Cascade. Level 'level' is cascaded when the indexes of all levels below
+      have wrapped around to 0. */
+   for (level = 1; level < TIMER_WHEEL_LEVELS; level++)
+   {
+      if (TIMER_WHEEL_INDEX(current_tick, level - 1) != 0)
+      {
+         break;
+      }
+
+      index = TIMER_WHEEL_INDEX(current_tick, level);
+      iter = timer_wheel[level][index];
+      timer_wheel[level][index] = 0;
+      while (iter != 0)
+      {
+         PCB *next = iter->next;
+         timerwheel_insert(iter);
+         iter = next;
+      }
+   }
+
+   /* Make the processes in the current lowest-level slot ready. */
+   index = TIMER_WHEEL_INDEX(current_tick, 0);
+   iter = timer_wheel[0][index];
+   timer_wheel[0][index] = 0;
+   while (iter != 0)
+   {
+      ready_pcb = iter;
+      iter = iter->next;
+      kernel_assert(ready_pcb->delay_until == current_tick);
+      TRACE(RTOS_TRACE_TICK_WAKEUP, ready_pcb->pid, current_tick & 0xFFFF);
+      ready_pcb->delay_link = 0;
+
+      /* A process in any other state than DELAY was in a timed wait, which
+         returns 0 at the timeout. */
+      if (ready_pcb->process_state != PROCESS_STATE_DELAY)
+      {
+         TRACE(RTOS_TRACE_TIMEOUT, ready_pcb->pid, ready_pcb->process_state);
+         arch_store_retval(0, ready_pcb);
+      }
+
+      readylist_insert_pcb(ready_pcb);
+      if (preempts_current(ready_pcb))
+      {
+         do_schedule = 1;
+      }
+   }
+
+   return do_schedule;
+}
+
+
+/******************************************************************************
+ * Function: ticks_advance
+ *
+ * Advances the tick counter 'nbr_ticks' ticks, making ready the processes
+ * whose delays have timed out. If any of them has higher priority than the
+ * current process, a context switch is scheduled. Interrupts must be
+ * disabled.
+ */
+static void ticks_advance(rtos_u32 nbr_ticks)
+{
+   int do_schedule = 0;
+
+   while (nbr_ticks > 0)
+   {
+      do_schedule |= timerwheel_advance();
+      nbr_ticks--;
+   }
+
+   if (do_schedule)
+   {
+     /* Schedule a context switch to take place after all active exceptions.
+        TODO: 'arch_trigger_pendsv' should have a better name, as it is a
+        Cortex-M3 exception name. */
+     arch_trigger_pendsv();
+   }
+}
+
+
+#if RTOS_TIME_SLICE > 0
+/******************************************************************************
+ * Function: time_slice_tick
+ *
+ * Counts down the time slice of the current process of each core. When it
+ * runs out and another process of the same priority is ready, the core is
+ * made to reschedule, and rtos_reschedule_hook puts the process last among
+ * them as for a preemption. Otherwise the process gets a new slice. The
+ * ticks skipped by tickless idle are not counted, as only the idle process
+ * runs then. Interrupts must be disabled, and with several cores the kernel
+ * lock must be held.
+ */
+static void time_slice_tick(void)
+{
+   rtos_u32 core = 0;
+   PCB *running = 0;
+
+   for (core = 0; core < RTOS_NBR_CORES; core++)
+   {
+#if RTOS_NBR_CORES > 1
+      running = rtos_current_pcbs[core];
+#else
+      running = current_pcb;
+#endif
+      if (running == 0 || --slice_ticks_left[core] != 0)
+      {
+         continue;
+      }
+
+      slice_ticks_left[core] = RTOS_TIME_SLICE;
+      if (running->process_state == PROCESS_STATE_RUNNING &&
+          ready_heads[core][running->priority] != 0)
+      {
+#if RTOS_NBR_CORES > 1
+         if (core != ARCH_CORE_ID())
+         {
+            arch_kick_core(core);
+            continue;
+         }
+#endif
+         arch_trigger_pendsv();
+      }
+   }
+}
+#endif
+
+
+#ifdef RTOS_TICKLESS_IDLE
+/******************************************************************************
+ * Function: timerwheel_next_event
+ *
+ * Returns the number of ticks until the timer wheel needs attention, i.e.
+ * until the next timeout or until the next cascade of a non-empty slot,
+ * whichever comes first. Timeouts in higher levels are only known to the
+ * slot, so the result may be earlier than the actual next timeout, but never
+ * later. Returns 0 if the timer wheel is empty.
+ */
+static rtos_u32 timerwheel_next_event(void)
+{
+   rtos_u32 next_event = 0;
+   rtos_u32 level = 0;
+   rtos_u32 distance = 0;
+
+   for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+   {
+      rtos_u32 shift = TIMER_WHEEL_BITS * level;
+      rtos_u32 base = current_tick >> shift;
+
+      /* Find the first non-empty slot after the current one. The current
+         slot of a level above 0 is reached again only after a full turn. */
+      for (distance = 1; distance <= TIMER_WHEEL_SLOTS; distance++)
+      {
+         if (timer_wheel[level][(base + distance) & (TIMER_WHEEL_SLOTS - 1)]
+             != 0)
+         {
+            rtos_u32 event = ((base + distance) << shift) - current_tick;
+
+            if (event != 0 && (next_event == 0 || event < next_event))
+            {
+               next_event = event;
+            }
+            break;
+         }
+      }
+   }
+
+   return next_event;
+}
+
+
+/******************************************************************************
+ * Function: idle_sleep
+ *
+ * Called from the idle process to sleep until the next timeout in the timer
+ * wheel, or until an interrupt makes a process ready. The periodic tick is
+ * stopped during the sleep, and the ticks that elapsed are credited to the
+ * tick counter afterwards.
+ */
+static void idle_sleep(void)
+{
+   rtos_u32 sleep_ticks = 0;
+   rtos_u32 elapsed_ticks = 0;
+   rtos_u32 skip_ticks = 0;
+
+   /* Mask all interrupts, so that no process is made ready between the check
+      below and the sleep. A pending interrupt still ends the sleep. */
+   INTERRUPT_MASK_ALL;
+   CRITICAL_PROFILE_START();
+
+   if (ready_bitmap[ARCH_CORE_ID()] == 0)
+   {
+      sleep_ticks = timerwheel_next_event();
+
+      /* The time asleep does not delay any interrupt handler. */
+      CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_IDLE);
+      elapsed_ticks = arch_tickless_sleep(sleep_ticks);
+      CRITICAL_PROFILE_START();
+
+      if (elapsed_ticks > 0)
+      {
+         /* Nothing happens in the timer wheel during the first
+            'sleep_ticks' - 1 ticks, so they can be skipped in one batch.
+            The remaining ticks are handled one by one. */
+         skip_ticks = elapsed_ticks;
+         if (sleep_ticks != 0 && sleep_ticks < skip_ticks)
+         {
+            skip_ticks = sleep_ticks;
+         }
+         skip_ticks--;
+
+         KERNEL_LOCK();
+         current_tick += skip_ticks;
+         ticks_advance(elapsed_ticks - skip_ticks);
+         KERNEL_UNLOCK();
+      }
+   }
+
+   CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_IDLE);
+   INTERRUPT_UNMASK_ALL;
+}
+#endif
+
+
+#if RTOS_CHECK_LEVEL >= 2
+/******************************************************************************
+ * Function: audit_failed
+ *
+ * Reports corruption found by the auditor and stops, like a failed assert.
+ */
+static void audit_failed(rtos_u32 error, rtos_u32 detail)
+{
+   rtos_audit_error = error;
+   rtos_audit_detail = detail;
+   while (1);
+}
+
+
+/******************************************************************************
+ * Function: audit_buffer
+ *
+ * Returns non-zero if the header and trailer magics of a buffer are intact.
+ */
+static int audit_buffer(BufferHeader *buffer_header)
+{
+   if (buffer_header->magic != BUFFER_HEADER_MAGIC ||
+       buffer_header->pool >= NBR_BUFFER_POOLS)
+   {
+      return 0;
+   }
+   return BUFFER_TRAILER(buffer_header)->magic == BUFFER_TRAILER_MAGIC;
+}
+
+
+/******************************************************************************
+ * Function: audit_ready_queue
+ *
+ * Verifies the FIFO of one priority level of the ready-queue of a core: no
+ * loop, only ready processes of that priority and core, the tail pointer and
+ * the bitmap.
+ */
+static void audit_ready_queue(rtos_u32 core, rtos_u32 priority)
+{
+   PCB *pcb = ready_heads[core][priority];
+   PCB *last = 0;
+   rtos_u32 length = 0;
+
+   while (pcb != 0)
+   {
+      if (++length > next_pid ||
+          pcb->priority != priority ||
+          pcb->core != core ||
+          pcb->process_state != PROCESS_STATE_READY)
+      {
+         audit_failed(AUDIT_ERROR_READY_QUEUE, (core << 8) | priority);
+      }
+      last = pcb;
+      pcb = pcb->next;
+   }
+
+   if ((last != 0 && ready_tails[core][priority] != last) ||
+       (last != 0) != ((ready_bitmap[core] & READY_BIT(priority)) != 0))
+   {
+      audit_failed(AUDIT_ERROR_READY_QUEUE, (core << 8) | priority);
+   }
+}
+
+
+/******************************************************************************
+ * Function: audit_timer_wheel_slot
+ *
+ * Verifies one slot of the timer wheel: no loop, only delayed processes and
+ * only processes whose 'delay_until' belongs in the slot.
+ */
+static void audit_timer_wheel_slot(rtos_u32 level, rtos_u32 index)
+{
+   PCB **link = &timer_wheel[level][index];
+   PCB *pcb = 0;
+   rtos_u32 length = 0;
+
+   while (*link != 0)
+   {
+      pcb = *link;
+      if (++length > next_pid ||
+          (pcb->process_state != PROCESS_STATE_DELAY &&
+           pcb->process_state != PROCESS_STATE_RECEIVE &&
+           pcb->process_state != PROCESS_STATE_PSEM) ||
+          pcb->delay_link != link ||
+          TIMER_WHEEL_INDEX(pcb->delay_until, level) != index)
+      {
+         audit_failed(AUDIT_ERROR_TIMER_WHEEL, (level << 8) | index);
+      }
+      link = &pcb->next;
+   }
+}
+
+
+/******************************************************************************
+ * Function: audit_inboxes
+ *
+ * Verifies the inboxes of one process: the message counts, the tail
+ * pointers, and the magics and reference counts of the buffers.
+ */
+static void audit_inboxes(PCB *pcb)
+{
+   MessageRef *ref = 0;
+   rtos_u32 inbox = 0;
+   rtos_u32 length = 0;
+   rtos_u32 priority = 0;
+   rtos_u32 last_priority = 0;
+   rtos_u32 priorities = 0;
+
+   for (inbox = 0; inbox < PCB_NBR_INBOXES; inbox++)
+   {
+      length = 0;
+      priorities = 0;
+      last_priority = RTOS_MESSAGE_PRIORITIES - 1;
+      for (ref = pcb->inbox[inbox]; ref != 0; ref = ref->next)
+      {
+         if (++length > pcb->inbox_count[inbox] ||
+             !audit_buffer(ref->buffer) ||
+             ref->buffer->refcount == 0)
+         {
+            audit_failed(AUDIT_ERROR_INBOX, (pcb->pid << 8) | inbox);
+         }
+
+         /* Priorities must not increase, and the last message of each
+            priority must be its tail. */
+         priority = ref->buffer->priority;
+         if (priority > last_priority ||
+             ((ref->next == 0 || ref->next->buffer->priority != priority) &&
+              pcb->inbox_tail[inbox][priority] != ref))
+         {
+            audit_failed(AUDIT_ERROR_INBOX, (pcb->pid << 8) | inbox);
+         }
+         priorities |= 1u << priority;
+         last_priority = priority;
+      }
+
+      if (length != pcb->inbox_count[inbox] ||
+          priorities != pcb->inbox_priorities[inbox])
+      {
+         audit_failed(AUDIT_ERROR_INBOX, (pcb->pid << 8) | inbox);
+      }
+      for (priority = 0; priority < RTOS_MESSAGE_PRIORITIES; priority++)
+      {
+         if ((priorities & (1u << priority)) == 0 &&
+             pcb->inbox_tail[inbox][priority] != 0)
+         {
+            audit_failed(AUDIT_ERROR_INBOX, (pcb->pid << 8) | inbox);
+         }
+      }
+   }
+}
+
+
+/******************************************************************************
+ * Function: audit_free_list
+ *
+ * Verifies the free-list of one buffer pool: no loop, found by letting a
+ * second pointer step twice as fast, and intact, unreferenced buffers of the
+ * right pool, as many as the pool statistics count as free.
+ */
+static void audit_free_list(rtos_u32 pool)
+{
+   BufferHeader *buffer_header = available_lists[pool];
+   BufferHeader *fast = available_lists[pool];
+#ifdef RTOS_BUFFER_STATS
+   rtos_u32 nbr_free = 0;
+#endif
+
+   while (buffer_header != 0)
+   {
+      if (!audit_buffer(buffer_header) || buffer_header->pool != pool ||
+          buffer_header->refcount != 0)
+      {
+         audit_failed(AUDIT_ERROR_FREE_LIST, pool);
+      }
+
+      if (fast != 0 && fast->next != 0)
+      {
+         fast = fast->next->next;
+         if (fast == buffer_header->next)
+         {
+            audit_failed(AUDIT_ERROR_FREE_LIST, pool);
+         }
+      }
+      buffer_header = buffer_header->next;
+#ifdef RTOS_BUFFER_STATS
+      nbr_free++;
+#endif
+   }
+
+#ifdef RTOS_BUFFER_STATS
+   if (nbr_free != pool_stats[pool].nbr_buffers - pool_stats[pool].nbr_used)
+   {
+      audit_failed(AUDIT_ERROR_FREE_LIST, pool);
+   }
+#endif
+}
+
+
+/******************************************************************************
+ * Function: audit_mutex
+ *
+ * Verifies a mutex: waiters only if it is owned, no loop and only processes
+ * that wait for this mutex, in priority order, and an owner that runs with
+ * at least the priority of the first waiter.
+ */
+static void audit_mutex(rtos_u32 mutex_id)
+{
+   Mutex *mutex = mutex_map[mutex_id];
+   PCB *pcb = mutex->waiters;
+   rtos_u32 length = 0;
+
+   if (pcb != 0 &&
+       (mutex->owner == 0 || mutex->owner->priority > pcb->priority))
+   {
+      audit_failed(AUDIT_ERROR_MUTEX, mutex_id);
+   }
+
+   while (pcb != 0)
+   {
+      if (++length > next_pid ||
+          pcb->process_state != PROCESS_STATE_MUTEX ||
+          pcb->mutex_wait != mutex ||
+          (pcb->next != 0 && pcb->next->priority < pcb->priority))
+      {
+         audit_failed(AUDIT_ERROR_MUTEX, mutex_id);
+      }
+      pcb = pcb->next;
+   }
+}
+
+
+/******************************************************************************
+ * Function: audit_event_group
+ *
+ * Verifies the waiters of an event group: no loop, only processes that wait
+ * for an event and are not satisfied by the flags, and the tail pointer.
+ */
+static void audit_event_group(rtos_u32 group_id)
+{
+   EventGroup *group = event_group_map[group_id];
+   PCB *pcb = group->waiters;
+   PCB *last = 0;
+   rtos_u32 length = 0;
+
+   while (pcb != 0)
+   {
+      if (++length > next_pid ||
+          pcb->process_state != PROCESS_STATE_EVENT ||
+          EVENT_SATISFIED(group->flags, pcb->event_mask, pcb->event_options))
+      {
+         audit_failed(AUDIT_ERROR_EVENT_GROUP, group_id);
+      }
+      last = pcb;
+      pcb = pcb->next;
+   }
+
+   if (group->waiters != 0 && group->waiters_tail != last)
+   {
+      audit_failed(AUDIT_ERROR_EVENT_GROUP, group_id);
+   }
+}
+
+
+/******************************************************************************
+ * Function: kernel_audit
+ *
+ * Verifies all kernel lists and buffers, one list at a time with interrupts
+ * masked and the lock of the list held, so that the kernel cannot change
+ * the list while it is checked. Runs in the idle process, so the checks
+ * cost no time in the kernel paths, and higher-priority processes preempt
+ * the audit between two lists. With several cores, all idle processes
+ * audit.
+ */
+static void kernel_audit(void)
+{
+   rtos_u32 core = 0;
+   rtos_u32 index = 0;
+   rtos_u32 level = 0;
+
+   for (core = 0; core < RTOS_NBR_CORES; core++)
+   {
+      for (index = 0; index < RTOS_NBR_PRIORITIES; index++)
+      {
+         INTERRUPT_MASK_ALL;
+         CRITICAL_PROFILE_START();
+         KERNEL_LOCK();
+         audit_ready_queue(core, index);
+         KERNEL_UNLOCK();
+         CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_AUDIT);
+         INTERRUPT_UNMASK_ALL;
+      }
+   }
+
+   for (level = 0; level < TIMER_WHEEL_LEVELS; level++)
+   {
+      for (index = 0; index < TIMER_WHEEL_SLOTS; index++)
+      {
+         INTERRUPT_MASK_ALL;
+         CRITICAL_PROFILE_START();
+         KERNEL_LOCK();
+         audit_timer_wheel_slot(level, index);
+         KERNEL_UNLOCK();
+         CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_AUDIT);
+         INTERRUPT_UNMASK_ALL;
+      }
+   }
+
+   for (index = 0; index < next_pid; index++)
+   {
+      INTERRUPT_MASK_ALL;
+      CRITICAL_PROFILE_START();
+      SPIN_LOCK(&pid_pcb_map[index]->inbox_lock);
+      audit_inboxes(pid_pcb_map[index]);
+      SPIN_UNLOCK(&pid_pcb_map[index]->inbox_lock);
+      CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_AUDIT);
+      INTERRUPT_UNMASK_ALL;
+   }
+
+   for (index = 0; index < NBR_BUFFER_POOLS; index++)
+   {
+      INTERRUPT_MASK_ALL;
+      CRITICAL_PROFILE_START();
+      SPIN_LOCK(&alloc_lock);
+      audit_free_list(index);
+      SPIN_UNLOCK(&alloc_lock);
+      CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_AUDIT);
+      INTERRUPT_UNMASK_ALL;
+   }
+
+   for (index = 0; index < next_mutex_id; index++)
+   {
+      INTERRUPT_MASK_ALL;
+      CRITICAL_PROFILE_START();
+      KERNEL_LOCK();
+      audit_mutex(index);
+      KERNEL_UNLOCK();
+      CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_AUDIT);
+      INTERRUPT_UNMASK_ALL;
+   }
+
+   for (index = 0; index < next_event_group_id; index++)
+   {
+      INTERRUPT_MASK_ALL;
+      CRITICAL_PROFILE_START();
+      KERNEL_LOCK();
+      audit_event_group(index);
+      KERNEL_UNLOCK();
+      CRITICAL_PROFILE_STOP(RTOS_CRITICAL_SITE_AUDIT);
+      INTERRUPT_UNMASK_ALL;
+   }
+
+   rtos_audit_passes++;
+}
+#endif
+
+
+/******************************************************************************
+ * Function: idle_process
+ *
+ * The idle process runs at the lowest priority, when no other process is
+ * ready. It puts the CPU to sleep until the next interrupt.
+ */
+static void idle_process(void)
+{
+   for (;;)
+   {
+#if RTOS_CHECK_LEVEL >= 2
+      kernel_audit();
+#endif
+#ifdef RTOS_TICKLESS_IDLE
+      idle_sleep();
+#else
+      WAIT_FOR_INTERRUPT;
+#endif
+   }
+}
+
+
+#if RTOS_WORK_QUEUES > 0
+/******************************************************************************
+ * Function: work_process
+ *
+ * The work process runs the items posted with rtos_defer_from_isr. It is
+ * signaled from rtos_reschedule_hook when work has been posted, and then
+ * drains the queues in turn. Work posted meanwhile leaves the psem
+ * signaled, so that it is run in the next round.
+ */
+static void work_process(void)
+{
+   rtos_u32 queue = 0;
+
+   for (;;)
+   {
+      rtos_wait_psem();
+      for (queue = 0; queue < RTOS_WORK_QUEUES; queue++)
+      {
+         work_queue_run(&work_queues[queue]);
+      }
+   }
+}
+
+
+/******************************************************************************
+ * Function: work_queue_run
+ *
+ * Runs the items of a work queue in batches, all that have been posted
+ * when the batch starts, until the queue is empty. The slot of an item is
+ * given back to the interrupt handler when the item has been run.
+ */
+static void work_queue_run(WorkQueue *queue)
+{
+   rtos_u32 tail = queue->tail;
+   rtos_u32 head = queue->head;
+   WorkItem *item = 0;
+
+   while (tail != head)
+   {
+      /* Read the items after the head that publishes them. */
+      ARCH_MEMORY_BARRIER();
+      do
+      {
+         item = &queue->items[tail & (RTOS_WORK_QUEUE_ITEMS - 1)];
+         item->function(item->arg);
+         tail++;
+
+         /* Done with the slot before giving it back. */
+         ARCH_MEMORY_BARRIER();
+         queue->tail = tail;
+      } while (tail != head);
+      head = queue->head;
+   }
+}
+#endif
+
+
+/******************************************************************************
+ * Function: rtos_tick_hook
+ *
+ * Entry point for the arch-specific tick interrupt handler.
+ */
+void rtos_tick_hook(void)
+{
+   rtos_tick_from_isr();
+}
+
+
+#ifdef RTOS_TRACE
+/******************************************************************************
+ * Function: trace_record
+ *
+ * Writes a record to the trace ring buffer, overwriting the oldest record
+ * when full. 'arg' is saturated to 16 bits. Interrupts must be disabled.
+ */
+static inline void trace_record(rtos_u8 event, rtos_u32 pid, rtos_u32 arg)
+{
+   RtosTraceRecord *record = 0;
+
+   SPIN_LOCK(&trace_lock);
+   record = &rtos_trace.records[rtos_trace.write_count &
+                                (RTOS_TRACE_RECORDS - 1)];
+   rtos_trace.write_count++;
+   record->timestamp = RTOS_TRACE_TIMESTAMP();
+   record->event = event;
+   record->pid = (rtos_u8) pid;
+   record->arg = arg > 0xFFFF ? 0xFFFF : (rtos_u16) arg;
+   SPIN_UNLOCK(&trace_lock);
+}
+#endif
+
+
+/******************************************************************************
+ * Function: buffer_create
+ *
+ * Allocates a new buffer for the specified pool from RAM space and writes its
+ * header and trailer. The buffer is not put in any free-list. Returns 0 if
+ * the RAM space is used up.
+ */
+static BufferHeader *buffer_create(rtos_u32 pool)
+{
+   rtos_u32 size = buffer_sizes[pool];
+   BufferHeader *buffer_header = (BufferHeader *)
+      kernel_alloc_permanent(BUFFER_HEADER_SIZE + size + BUFFER_TRAILER_SIZE,
+                             sizeof(rtos_address));
+
+   if (buffer_header != 0)
+   {
+      buffer_init(buffer_header, pool);
+   }
+
+   return buffer_header;
+}
+
+
+/******************************************************************************
+ * Function: buffer_init
+ *
+ * Writes the header and trailer of a new buffer for the specified pool.
+ */
+static void buffer_init(BufferHeader *buffer_header, rtos_u32 pool)
+{
+   buffer_header->magic = BUFFER_HEADER_MAGIC;
+   buffer_header->next = 0;
+   buffer_header->ref.next = 0;
+   buffer_header->ref.buffer = buffer_header;
+   buffer_header->refcount = 0;
+   buffer_header->ref_used = 0;
+   buffer_header->pool = pool;
+   buffer_header->priority = 0;
+   BUFFER_TRAILER(buffer_header)->magic = BUFFER_TRAILER_MAGIC;
+#ifdef RTOS_BUFFER_STATS
+   pool_stats[pool].nbr_buffers++;
+#endif
+}
+
+
+/******************************************************************************
+ * Function: buffer_pools_init
+ *
+ * Builds the size-to-pool lookup table and allocates the buffers that are
+ * configured to be allocated at start-up. With the static configuration,
+ * these are the preallocated buffers of its pools instead.
+ */
+static void buffer_pools_init(void)
+{
+   rtos_u32 max_index = POOL_LOOKUP_INDEX(buffer_sizes[NBR_BUFFER_POOLS - 1]);
+   rtos_u32 index = 0;
+   rtos_u32 pool = 0;
+   rtos_u32 count = 0;
+   BufferHeader *buffer_header = 0;
+
+   kernel_assert(NBR_BUFFER_POOLS <= 256);
+   kernel_assert(sizeof(buffer_prealloc) == sizeof(buffer_sizes));
+#ifdef RTOS_STATIC_CONFIG
+   kernel_assert(rtos_static_nbr_pools == NBR_BUFFER_POOLS);
+#endif
+
+   /* Entry 'index' holds the smallest pool with buffers of at least
+      'index' << POOL_LOOKUP_SHIFT bytes. */
+   pool_lookup = (rtos_u8 *) kernel_alloc_permanent(max_index + 1, 1);
+   kernel_assert(pool_lookup != 0);
+   for (index = 0; index <= max_index; index++)
+   {
+      while (buffer_sizes[pool] < (index << POOL_LOOKUP_SHIFT))
+      {
+         pool++;
+      }
+      pool_lookup[index] = pool;
+   }
+
+   for (pool = 0; pool < NBR_BUFFER_POOLS; pool++)
+   {
+      kernel_assert((buffer_sizes[pool] & 3) == 0);
+      kernel_assert(pool == 0 || buffer_sizes[pool - 1] < buffer_sizes[pool]);
+
+      available_lists[pool] = 0;
+#ifdef RTOS_STATIC_CONFIG
+      kernel_assert(rtos_static_pools[pool].buffer_size == buffer_sizes[pool]);
+      for (count = 0; count < rtos_static_pools[pool].nbr_buffers; count++)
+      {
+         buffer_header = (BufferHeader *)
+            (rtos_static_pools[pool].memory +
+             count * RTOS_STATIC_BUFFER_BYTES(buffer_sizes[pool]));
+         buffer_init(buffer_header, pool);
+
+         buffer_header->next = available_lists[pool];
+         available_lists[pool] = buffer_header;
+      }
+#else
+      for (count = 0; count < buffer_prealloc[pool]; count++)
+      {
+         buffer_header = buffer_create(pool);
+         kernel_assert(buffer_header != 0);
+
+         buffer_header->next = available_lists[pool];
+         available_lists[pool] = buffer_header;
+      }
+#endif
+   }
+}
+
+
+/******************************************************************************
+ * Function: kernel_alloc_permanent
+ *
+ * Permanently allocates memory with the specified size and alignment.
+ * Returns 0 if the kernel pool, which ends at ARCH_KERNEL_POOL_END, is used
+ * up. Interrupts must be disabled, unless the kernel has not been started.
+ */
+static rtos_address kernel_alloc_permanent(rtos_u32 size, rtos_u8 alignment)
+{
+   /* The next correctly aligned address. */
+   rtos_address data_block =
+      (permanent_data_ptr + alignment - 1) & ~((rtos_address) alignment - 1);
+
+   /* Fail without moving permanent_data_ptr if the aligned block does not
+      fit before the end of the pool. */
+   if (data_block > ARCH_KERNEL_POOL_END ||
+       size > ARCH_KERNEL_POOL_END - data_block)
+   {
+      return 0;
+   }
+
+   permanent_data_ptr = data_block + size;
+
+   return data_block;
+}
+
+/******************************************************************************
+ * Function: process_create
+ *
+ * Creates a process. Allocates its PCB and stack and initializes them with
+ * process_init. Returns the pid of the new process.
+ */
+static rtos_u32 process_create(rtos_address entry, rtos_u16 stack_size,
+                               rtos_u8 priority, rtos_u32 core)
+{
+  PCB *pcb = 0;
+  rtos_address stack_base = 0;
+
+   /* Allocate permanent space for the PCB and stack.
+      Make stack 8-byte aligned, this is required for Cortex-M3,
+      but this could of course be configured per architecture. */
+   pcb = (PCB *) kernel_alloc_permanent(sizeof(PCB), sizeof(rtos_address));
+   stack_base = (rtos_address) kernel_alloc_permanent(stack_size, 8);
+   kernel_assert(pcb != 0 && stack_base != 0);
+
+   return process_init(pcb, entry, stack_base, stack_size, priority, core);
+}
+
+
+/******************************************************************************
+ * Function: process_init
+ *
+ * Initializes the PCB and stack of a new process and puts the process in
+ * the readylist of 'core'. The process gets the next pid, which is
+ * returned.
+ */
+static rtos_u32 process_init(PCB *pcb, rtos_address entry,
+                             rtos_address stack_base, rtos_u16 stack_size,
+                             rtos_u8 priority, rtos_u32 core)
+{
+  rtos_u32 pid = next_pid;
+  rtos_u32 inbox = 0;
+  rtos_u32 message_priority = 0;
+#ifdef RTOS_PROCESS_STATS
+  rtos_u32 *stack_word = 0;
+#endif
+
+#ifdef RTOS_PROCESS_STATS
+   /* Paint the stack, for stack_high_water. */
+   for (stack_word = (rtos_u32 *) stack_base;
+        stack_word < (rtos_u32 *) (stack_base + (stack_size & ~3));
+        stack_word++)
+   {
+      *stack_word = STACK_PAINT;
+   }
+   pcb->run_cycles = 0;
+   pcb->switch_count = 0;
+#endif
+#ifdef RTOS_BUFFER_STATS
+   pcb->buffers_held = 0;
+#endif
+
+   pcb->entry = entry;
+   pcb->thread_stack_top = stack_base + stack_size;
+   pcb->stack_size = stack_size;
+   pcb->sp = 0;
+   pcb->next = 0;
+   pcb->priority = priority;
+   pcb->base_priority = priority;
+   pcb->core = core;
+   pcb->pid = pid;
+
+   for (inbox = 0; inbox < PCB_NBR_INBOXES; inbox++)
+   {
+      pcb->inbox[inbox] = 0;
+      for (message_priority = 0; message_priority < RTOS_MESSAGE_PRIORITIES;
+           message_priority++)
+      {
+         pcb->inbox_tail[inbox][message_priority] = 0;
+      }
+      pcb->inbox_count[inbox] = 0;
+      pcb->inbox_priorities[inbox] = 0;
+   }
+#if RTOS_NBR_CORES > 1
+   pcb->inbox_lock = 0;
+#endif
+   pcb->process_state = PROCESS_STATE_READY;
+   pcb->receive_mask = 0;
+   pcb->receive_inbox = 0;
+   pcb->receive_buffer = 0;
+
+   /* Initialize process specific semaphore. */
+   pcb->psem_value = 0;
+
+   pcb->mutex_wait = 0;
+   pcb->mutexes_held = 0;
+   pcb->event_mask = 0;
+   pcb->event_options = 0;
+   pcb->delay_link = 0;
+
+   /* Let the arch-specific code init PCB and stack. */
+   arch_init_stack(pcb);
+
+   /* Count the process before putting it in the readylist, the list check
+      uses the number of processes as maximum list length. */
+   next_pid++;
+
+   /* Put in readylist. */
+   readylist_insert_pcb(pcb);
+
+   return pid;
+}
+
+
+#ifdef RTOS_PROCESS_STATS
+/******************************************************************************
+ * Function: stack_high_water
+ *
+ * Returns the deepest stack use of the process so far, in bytes, i.e. the
+ * size of its stack less the words at the bottom that still hold the paint
+ * from process_create. Interrupts must be disabled.
+ */
+static rtos_u32 stack_high_water(PCB *pcb)
+{
+   rtos_address stack_base = pcb->thread_stack_top - pcb->stack_size;
+   rtos_u32 *stack_word = (rtos_u32 *) stack_base;
+   rtos_u32 *stack_end = (rtos_u32 *) (stack_base + (pcb->stack_size & ~3));
+
+   while (stack_word < stack_end && *stack_word == STACK_PAINT)
+   {
+      stack_word++;
+   }
+
+   return pcb->thread_stack_top - (rtos_address) stack_word;
+}
+#endif
+
+
+#ifdef RTOS_CRITICAL_PROFILE
+/******************************************************************************
+ * Function: rtos_critical_profile_start
+ *
+ * Called when a critical section has been entered. Only the outermost
+ * section of nested ones is timed.
+ */
+void rtos_critical_profile_start(void)
+{
+   rtos_u32 core = ARCH_CORE_ID();
+
+   if (critical_depth[core]++ == 0)
+   {
+      critical_start[core] = RTOS_TRACE_TIMESTAMP();
+   }
+}
+
+
+/******************************************************************************
+ * Function: rtos_critical_profile_stop
+ *
+ * Called when a critical section is about to be left. Accounts the time
+ * since the outermost section was entered to 'site'.
+ */
+void rtos_critical_profile_stop(rtos_u32 site)
+{
+   rtos_u32 core = ARCH_CORE_ID();
+   rtos_u32 elapsed = 0;
+   rtos_critical_site_stats *stats = &critical_stats[site];
+
+   kernel_assert(critical_depth[core] > 0);
+   if (--critical_depth[core] == 0)
+   {
+      elapsed = RTOS_TRACE_TIMESTAMP() - critical_start[core];
+      SPIN_LOCK(&profile_lock);
+      stats->count++;
+      stats->total_cycles += elapsed;
+      if (elapsed > stats->max_cycles)
+      {
+         stats->max_cycles = elapsed;
+      }
+      SPIN_UNLOCK(&profile_lock);
+   }
+}
+#endif
+
+
+/******************************************************************************
+ * Function:  rtos_context_switch_hook
+ *
+ * Called to do administration before context switch.
+ * Updates new_pcb before context switch is performed by arch specific
+ * assembly code. The work process is signaled first if an interrupt handler
+ * has posted work. A current process that is still RUNNING was preempted,
+ * or its time slice ran out, and is put last in the readylist, of the core
+ * it has migrated to if it has.
+ * Interrupts must be disabled, and with several cores the kernel lock must
+ * be held, see rtos_kernel_lock.
+ */
+void rtos_reschedule_hook()
+{
+   rtos_u32 core = ARCH_CORE_ID();
+
+#if RTOS_WORK_QUEUES > 0
+   /* Work posted by an interrupt handler. The work process is made ready
+      before picking the next process, so that it is picked if it has the
+      highest priority. Work posted after the flag is cleared sets it
+      again. */
+   if (work_pending)
+   {
+      work_pending = 0;
+      psem_signal(work_pcb);
+   }
+#endif
+
+   if (current_pcb->process_state == PROCESS_STATE_RUNNING)
+   {
+      readylist_insert_pcb(current_pcb);
+   }
+   new_pcb = readylist_remove_highest(core);
+   new_pcb->process_state = PROCESS_STATE_RUNNING;
+   TRACE(RTOS_TRACE_SWITCH, current_pcb->pid, new_pcb->pid);
+
+#if RTOS_TIME_SLICE > 0
+   if (new_pcb != current_pcb)
+   {
+      slice_ticks_left[core] = RTOS_TIME_SLICE;
+   }
+#endif
+
+#ifdef RTOS_PROCESS_STATS
+   if (new_pcb != current_pcb)
+   {
+      rtos_u32 now = RTOS_TRACE_TIMESTAMP();
+
+      current_pcb->run_cycles += now - switch_timestamp[core];
+      switch_timestamp[core] = now;
+      new_pcb->switch_count++;
+   }
+#else
+   (void) core;
+#endif
+}
+
+
+#if RTOS_NBR_CORES > 1
+/******************************************************************************
+ * Function: rtos_kernel_lock
+ */
+void rtos_kernel_lock(void)
+{
+   KERNEL_LOCK();
+}
+
+
+/******************************************************************************
+ * Function: rtos_kernel_unlock
+ */
+void rtos_kernel_unlock(void)
+{
+   KERNEL_UNLOCK();
+}
+#endif
 
-  /* Set up static variables. */
-  permanent_data_ptr = (rtos_address) &_kernel_pool_start;
+
+#ifdef RTOS_STATIC_CONFIG
+/******************************************************************************
+ * Function: static_config_init
+ *
+ * Sets up the processes, mutexes and event groups of the static
+ * configuration, see rtos_static.h. The pid, mutex and event group maps are
+ * the generated ones, and the mutexes and event groups are already cleared
+ * in .bss.
+ */
+static void static_config_init(void)
+{
+  const RtosStaticProcess *process = 0;
+  rtos_u32 pid = 0;
+
+  kernel_assert(rtos_static_nbr_processes >
+                RTOS_NBR_CORES + (RTOS_WORK_QUEUES > 0));
+
+  for (pid = 0; pid < rtos_static_nbr_processes; pid++) {
+    process = &rtos_static_processes[pid];
+    kernel_assert(process->core < RTOS_NBR_CORES);
+    if (pid >= rtos_static_nbr_processes - RTOS_NBR_CORES) {
+      /* The idle process of a core, which runs when no other process of
+         the core is ready. */
+      kernel_assert(process->entry == 0);
+      process_init(rtos_static_pid_map[pid], (rtos_address) idle_process,
+                   process->stack, process->stack_size, IDLE_PRIORITY,
+                   process->core);
+    }
+#if RTOS_WORK_QUEUES > 0
+    else if (pid == rtos_static_nbr_processes - RTOS_NBR_CORES - 1) {
+      /* The work process, just before the idle processes. */
+      kernel_assert(process->entry == 0);
+      kernel_assert(process->priority == RTOS_WORK_PRIORITY);
+      work_pcb = rtos_static_pid_map[pid];
+      process_init(work_pcb, (rtos_address) work_process, process->stack,
+                   process->stack_size, RTOS_WORK_PRIORITY, process->core);
+    }
+#endif
+    else {
+      kernel_assert(process->priority < IDLE_PRIORITY);
+      process_init(rtos_static_pid_map[pid], process->entry,
+                   process->stack, process->stack_size, process->priority,
+                   process->core);
+    }
+  }
+
+  pid_pcb_map = rtos_static_pid_map;
+  mutex_map = rtos_static_mutex_map;
+  next_mutex_id = rtos_static_nbr_mutexes;
+  event_group_map = rtos_static_event_group_map;
+  next_event_group_id = rtos_static_nbr_event_groups;
+}
+#else
+/******************************************************************************
+ * Function: dynamic_config_init
+ *
+ * Lets the application create its processes, mutexes and event groups in
+ * rtos_hook_create_processes, creates the work process, if configured, and
+ * the idle processes and builds the maps from pids and ids to them.
+ */
+static void dynamic_config_init(void)
+{
+  PCB *pcb_iterator = 0;
+  PCB **pid_map = 0;
+  Mutex **mutexes = 0;
+  EventGroup **groups = 0;
+  rtos_u32 core = 0;
+  rtos_u32 priority = 0;
+  rtos_u32 mutex_id = 0;
+  rtos_u32 group_id = 0;
+#if RTOS_WORK_QUEUES > 0
+  rtos_u32 work_pid = 0;
+#endif
 
   /* Allow application to create processes. */
   rtos_hook_create_processes();
 
+#if RTOS_WORK_QUEUES > 0
+  /* The work process, which runs the deferred work on core 0. */
+  work_pid = process_create((rtos_address) work_process,
+                            RTOS_WORK_STACK_SIZE, RTOS_WORK_PRIORITY, 0);
+#endif
+
+  /* Create the idle process of each core, which runs when no other process
+     of the core is ready. */
+  for (core = 0; core < RTOS_NBR_CORES; core++) {
+    process_create((rtos_address) idle_process, RTOS_IDLE_STACK_SIZE,
+                   IDLE_PRIORITY, core);
+  }
+
   /* Create an array that maps pids to PCB:s. Fill it with PCB pointers. */
-  pid_pcb_map = (PCB **)
+  pid_map = (PCB **)
     kernel_alloc_permanent(next_pid * sizeof(PCB *), sizeof(PCB *));
+  kernel_assert(pid_map != 0);
+
+  for (core = 0; core < RTOS_NBR_CORES; core++) {
+    for (priority = 0; priority < RTOS_NBR_PRIORITIES; priority++) {
+      for (pcb_iterator = ready_heads[core][priority];
+           pcb_iterator != 0;
+           pcb_iterator = pcb_iterator->next) {
+        pid_map[pcb_iterator->pid] = pcb_iterator;
+      }
+    }
+  }
+  pid_pcb_map = pid_map;
+#if RTOS_WORK_QUEUES > 0
+  work_pcb = pid_map[work_pid];
+#endif
+
+  /* Likewise for the mutexes, which are listed newest first. */
+  mutexes = (Mutex **)
+    kernel_alloc_permanent(next_mutex_id * sizeof(Mutex *), sizeof(Mutex *));
+  kernel_assert(next_mutex_id == 0 || mutexes != 0);
+
+  for (mutex_id = next_mutex_id; mutex_id > 0; mutex_id--) {
+    mutexes[mutex_id - 1] = mutex_list;
+    mutex_list = mutex_list->next_held;
+    mutexes[mutex_id - 1]->next_held = 0;
+  }
+  mutex_map = mutexes;
+
+  groups = (EventGroup **)
+    kernel_alloc_permanent(next_event_group_id * sizeof(EventGroup *),
+                           sizeof(EventGroup *));
+  kernel_assert(next_event_group_id == 0 || groups != 0);
 
-  for (pcb_iterator = ready_pcbs;
-       pcb_iterator != 0;
-       pcb_iterator = pcb_iterator->next) {
-    pid_pcb_map[pcb_iterator->pid] = pcb_iterator;
+  for (group_id = next_event_group_id; group_id > 0; group_id--) {
+    groups[group_id - 1] = event_group_list;
+    event_group_list = event_group_list->next;
   }
+  event_group_map = groups;
+}
+#endif
+
+
+/******************************************************************************
+ * Function:   rtos_init
+ *
+ * Called from boot code, after BSS and DATA have been initialized.
+ */
+void rtos_init()
+{
+#if RTOS_NBR_CORES > 1
+  rtos_u32 core = 0;
+#endif
+
+  /* Set up static variables. */
+  permanent_data_ptr = (rtos_address) _kernel_pool_start;
+
+  /* Set up the buffer pools used by rtos_alloc. */
+  buffer_pools_init();
+
+  /* Set up the processes, mutexes and event groups. */
+#ifdef RTOS_STATIC_CONFIG
+  static_config_init();
+#else
+  dynamic_config_init();
+#endif
 
   /* Enable peripherals, peripheral clocks, interrupts etc. from BSP.
      This should be done as late as possible to save power. */
   soc_start_hook();
 
+#if RTOS_NBR_CORES > 1
+  /* The other cores start with their highest-priority processes, when
+     arch_start starts them. */
+  for (core = 1; core < RTOS_NBR_CORES; core++) {
+    rtos_current_pcbs[core] = readylist_remove_highest(core);
+    rtos_current_pcbs[core]->process_state = PROCESS_STATE_RUNNING;
+#ifdef RTOS_PROCESS_STATS
+    rtos_current_pcbs[core]->switch_count++;
+    switch_timestamp[core] = RTOS_TRACE_TIMESTAMP();
+#endif
+#if RTOS_TIME_SLICE > 0
+    slice_ticks_left[core] = RTOS_TIME_SLICE;
+#endif
+  }
+#endif
+
   /* Activate the highest-priority process (or one of them). */
-  if (ready_pcbs != 0) {
-    current_pcb = ready_pcbs;
-    ready_pcbs = ready_pcbs->next;
+  if (ready_bitmap[0] != 0) {
+    current_pcb = readylist_remove_highest(0);
 
     current_pcb->process_state = PROCESS_STATE_RUNNING;
+#ifdef RTOS_PROCESS_STATS
+    current_pcb->switch_count++;
+    switch_timestamp[0] = RTOS_TRACE_TIMESTAMP();
+#endif
+#if RTOS_TIME_SLICE > 0
+    slice_ticks_left[0] = RTOS_TIME_SLICE;
+#endif
     arch_start((struct PCB *) current_pcb);
   }
 
@@ -683,39 +3555,201 @@ void rtos_init()
 rtos_u32 rtos_create_process(rtos_address entry, rtos_u16 stack_size,
 rtos_u8 priority)
 {
-  PCB *pcb = 0;
-  rtos_address stack_base = 0;
-  rtos_u32 pid = next_pid;
+   /* The lowest priority is reserved for the idle process. */
+   kernel_assert(priority < IDLE_PRIORITY);
 
-   /* Allocate permanent space for the PCB and stack.
-      Make stack 8-byte aligned, this is required for Cortex-M3,
-      but this could of course be configured per architecture. */
-   pcb = (PCB *) kernel_alloc_permanent(sizeof(PCB), sizeof(rtos_u32));
-   stack_base = (rtos_address) kernel_alloc_permanent(stack_size, 8);
+   return process_create(entry, stack_size, priority, 0);
+}
 
-   pcb->entry = entry;
-   pcb->thread_stack_top = stack_base + stack_size;
-   pcb->sp = 0;
-   pcb->next = 0;
-   pcb->priority = priority;
-   pcb->pid = pid;
+/******************************************************************************
+ * Function: rtos_create_process_on_core
+ *
+ * Only to be called from application during rtos_hook_create_processes.
+ */
+rtos_u32 rtos_create_process_on_core(rtos_address entry, rtos_u16 stack_size,
+                                     rtos_u8 priority, rtos_u32 core)
+{
+   kernel_assert(priority < IDLE_PRIORITY);
+   kernel_assert(core < RTOS_NBR_CORES);
 
-   pcb->inbox[0] = 0;
-   pcb->inbox[1] = 0;
-   pcb->inbox[2] = 0;
-   pcb->inbox[3] = 0;
-   pcb->process_state = PROCESS_STATE_READY;
-   pcb->receive_from = 0;
+   return process_create(entry, stack_size, priority, core);
+}
 
-   /* Initialize process specific semaphore. */
-   pcb->psem_value = 0;
+/******************************************************************************
+ * Function: rtos_create_mutex
+ *
+ * Only to be called from application during rtos_hook_create_processes.
+ * Returns the id of a new, unlocked mutex.
+ */
+rtos_u32 rtos_create_mutex(void)
+{
+   Mutex *mutex = (Mutex *)
+      kernel_alloc_permanent(sizeof(Mutex), sizeof(rtos_address));
 
-   /* Let the arch-specific code init PCB and stack. */
-   arch_init_stack(pcb);
+   kernel_assert(current_pcb == 0 && mutex != 0);
 
-   /* Put in readylist. */
-   readylist_insert_pcb(pcb);
+   mutex->owner = 0;
+   mutex->waiters = 0;
+   mutex->next_held = mutex_list;
+   mutex_list = mutex;
 
-   next_pid++;
-   return pid;
+   return next_mutex_id++;
+}
+
+/******************************************************************************
+ * Function: rtos_create_event_group
+ *
+ * Only to be called from application during rtos_hook_create_processes.
+ * Returns the id of a new event group with all flags cleared.
+ */
+rtos_u32 rtos_create_event_group(void)
+{
+   EventGroup *group = (EventGroup *)
+      kernel_alloc_permanent(sizeof(EventGroup), sizeof(rtos_address));
+
+   kernel_assert(current_pcb == 0 && group != 0);
+
+   group->flags = 0;
+   group->waiters = 0;
+   group->waiters_tail = 0;
+   group->next = event_group_list;
+   event_group_list = group;
+
+   return next_event_group_id++;
+}
+
+/******************************************************************************
+ * SECTION: Interrupt Handler Calls
+ *
+ * In this section are the variants of the syscalls that are called from
+ * interrupt handlers. They call the syscall handlers directly with the
+ * kernel interrupts disabled, instead of trapping into the kernel. A context
+ * switch that they cause is performed by the arch-specific code when all
+ * interrupt handlers have finished, as for the syscalls.
+ *
+ * Only interrupts that are disabled by INTERRUPT_DISABLE_SAVE may use these
+ * calls, and processes must use the syscalls instead.
+ *
+ *****************************************************************************/
+
+
+/******************************************************************************
+ * Function: rtos_send_from_isr
+ */
+void rtos_send_from_isr(rtos_address buffer_address, rtos_u32 dest_pid,
+                        rtos_u32 dest_inbox)
+{
+   rtos_u32 saved = 0;
+
+   CRITICAL_ENTER(RTOS_CRITICAL_SITE_SEND_FROM_ISR, saved);
+   message_send(buffer_address, dest_pid, dest_inbox);
+   CRITICAL_EXIT(RTOS_CRITICAL_SITE_SEND_FROM_ISR, saved);
+}
+
+
+/******************************************************************************
+ * Function: rtos_signal_psem_from_isr
+ */
+void rtos_signal_psem_from_isr(rtos_u32 pid)
+{
+   rtos_u32 saved = 0;
+
+   CRITICAL_ENTER(RTOS_CRITICAL_SITE_SIGNAL_PSEM_FROM_ISR, saved);
+   rtosint_signal_psem(pid);
+   CRITICAL_EXIT(RTOS_CRITICAL_SITE_SIGNAL_PSEM_FROM_ISR, saved);
+}
+
+
+/******************************************************************************
+ * Function: rtos_tick_from_isr
+ */
+void rtos_tick_from_isr(void)
+{
+   rtos_u32 saved = 0;
+
+   CRITICAL_ENTER(RTOS_CRITICAL_SITE_TICK, saved);
+   rtosint_tick();
+   CRITICAL_EXIT(RTOS_CRITICAL_SITE_TICK, saved);
+}
+
+
+/******************************************************************************
+ * Function: rtos_alloc_from_isr
+ */
+rtos_address rtos_alloc_from_isr(rtos_u32 nbr_bytes)
+{
+   rtos_address buffer_address = 0;
+   rtos_u32 saved = 0;
+
+   CRITICAL_ENTER(RTOS_CRITICAL_SITE_ALLOC_FROM_ISR, saved);
+   buffer_address = buffer_alloc(nbr_bytes, 0);
+   CRITICAL_EXIT(RTOS_CRITICAL_SITE_ALLOC_FROM_ISR, saved);
+
+   return buffer_address;
+}
+
+
+/******************************************************************************
+ * Function: rtos_dispose_from_isr
+ */
+void rtos_dispose_from_isr(rtos_address buffer_address)
+{
+   rtos_u32 saved = 0;
+
+   CRITICAL_ENTER(RTOS_CRITICAL_SITE_DISPOSE_FROM_ISR, saved);
+   buffer_dispose(buffer_address, 0);
+   CRITICAL_EXIT(RTOS_CRITICAL_SITE_DISPOSE_FROM_ISR, saved);
+}
+
+
+/******************************************************************************
+ * Function: rtos_event_set_from_isr
+ */
+void rtos_event_set_from_isr(rtos_u32 group_id, rtos_u32 flags)
+{
+   rtos_u32 saved = 0;
+
+   CRITICAL_ENTER(RTOS_CRITICAL_SITE_EVENT_SET_FROM_ISR, saved);
+   rtosint_event_set(group_id, flags);
+   CRITICAL_EXIT(RTOS_CRITICAL_SITE_EVENT_SET_FROM_ISR, saved);
+}
+
+
+#if RTOS_WORK_QUEUES > 0
+/******************************************************************************
+ * Function: rtos_defer_from_isr
+ *
+ * Posts a work item without masking interrupts or taking a lock, so it is
+ * not in the section above. The interrupt handler that owns the queue is
+ * its only writer of 'head', and the work process its only writer of
+ * 'tail'. The context switch that it schedules signals the work process.
+ */
+rtos_u32 rtos_defer_from_isr(rtos_u32 queue, rtos_work_function function,
+                             rtos_address arg)
+{
+   WorkQueue *work_queue = 0;
+   rtos_u32 head = 0;
+   WorkItem *item = 0;
+
+   kernel_assert(queue < RTOS_WORK_QUEUES);
+
+   work_queue = &work_queues[queue];
+   head = work_queue->head;
+   if (head - work_queue->tail == RTOS_WORK_QUEUE_ITEMS)
+   {
+      return 0;
+   }
+
+   item = &work_queue->items[head & (RTOS_WORK_QUEUE_ITEMS - 1)];
+   item->function = function;
+   item->arg = arg;
+
+   /* Publish the item after writing it. */
+   ARCH_MEMORY_BARRIER();
+   work_queue->head = head + 1;
+   work_pending = 1;
+   arch_trigger_pendsv();
+
+   return 1;
 }
+#endif
@@ -0,0 +1,88 @@
+/*****************************************************************************
+ * kernel_arch.h - Macros to be called from the kernel
+ * (portable or arch specific).
+ *
+ * Posix (Linux host) version. The tick interrupt is emulated by the SIGALRM
+ * signal and other interrupts by attached signals. The kernel always runs
+ * with these signals blocked, i.e. the "interrupts" have the same priority
+ * as the syscalls.
+ *
+ * With several cores, each core is a host thread, see kernel_arch.c.
+ *
+ *****************************************************************************/
+
+#ifndef KERNEL_ARCH_H
+#define KERNEL_ARCH_H
+
+#include "rtos_types.h"
+
+extern void posix_interrupt_mask_all(void);
+extern void posix_interrupt_unmask_all(void);
+extern void posix_wait_for_interrupt(void);
+extern rtos_u32 posix_timestamp(void);
+
+/* Attaches an interrupt handler, which may use the *_from_isr calls, to a
+   signal. */
+extern void posix_interrupt_attach(int signal_number, void (*handler)(void));
+
+/* All kernel code runs with the interrupt signals blocked, so there is
+   nothing more to disable. */
+#define INTERRUPT_DISABLE_SAVE(saved) do { (saved) = 0; } while(0)
+#define INTERRUPT_ENABLE_SAVED(saved) do { (void) (saved); } while(0)
+
+/* Macros to mask/unmask the tick signal outside of the kernel, used by the
+   idle process around sleeping. A context switch that was scheduled while
+   masked is performed when unmasking. */
+#define INTERRUPT_MASK_ALL \
+   do { posix_interrupt_mask_all(); } while(0)
+
+#define INTERRUPT_UNMASK_ALL \
+   do { posix_interrupt_unmask_all(); } while(0)
+
+/* Sleep until a signal is delivered. */
+#define WAIT_FOR_INTERRUPT \
+   do { posix_wait_for_interrupt(); } while(0)
+
+/* Size and end of the memory that the kernel allocates PCBs, stacks and
+   buffers from, _kernel_pool_start. */
+#ifndef RTOS_POSIX_POOL_SIZE
+#define RTOS_POSIX_POOL_SIZE (8 * 1024 * 1024)
+#endif
+
+extern rtos_address _kernel_pool_start[];
+#define ARCH_KERNEL_POOL_END \
+   ((rtos_address) _kernel_pool_start + RTOS_POSIX_POOL_SIZE)
+
+/* Time stamp for trace records, the critical-section profiler and the
+   process statistics, in nanoseconds of the host's monotonic clock. */
+#define RTOS_TRACE_TIMESTAMP() posix_timestamp()
+#define RTOS_TRACE_TIMESTAMP_HZ 1000000000
+
+/* Orders the memory accesses before it before those after it, for the
+   data that interrupt handlers share with the kernel without masking
+   interrupts, such as the deferred work queues. Signal handlers may run on
+   another core's thread. */
+#define ARCH_MEMORY_BARRIER() __atomic_thread_fence(__ATOMIC_SEQ_CST)
+
+#if RTOS_NBR_CORES > 1
+extern rtos_u32 posix_core_id(void);
+extern void posix_spin_lock(volatile rtos_u32 *lock);
+
+/* The core, i.e. host thread, that the caller runs on. */
+#define ARCH_CORE_ID() posix_core_id()
+
+/* Spinlocks between the cores. A lock is an rtos_u32 that is 0 when free.
+   The interrupt signals of the calling core must be blocked. */
+#define ARCH_SPIN_LOCK(lock) posix_spin_lock(lock)
+#define ARCH_SPIN_UNLOCK(lock) __atomic_store_n((lock), 0, __ATOMIC_RELEASE)
+#else
+#define ARCH_CORE_ID() 0
+#endif
+
+/* Count leading zeros of 'value'. The result is 32 if 'value' is zero. */
+static inline rtos_u32 arch_clz(rtos_u32 value)
+{
+   return value == 0 ? 32 : (rtos_u32) __builtin_clz(value);
+}
+
+#endif
@@ -0,0 +1,633 @@
+/*****************************************************************************
+ * kernel_arch.c - Architecture support for running the kernel as a native
+ * Linux (posix) process.
+ *
+ * All processes run in one host thread, each in its own ucontext on its
+ * kernel allocated stack. A periodic SIGALRM emulates the tick interrupt,
+ * and the application may attach handlers for other signals, emulating
+ * interrupts that use the kernel API through the *_from_isr calls. These
+ * interrupt signals are blocked while the kernel runs and while an
+ * interrupt handler runs. Syscalls are function calls that block them while
+ * the portable handler runs, so the kernel is never interrupted. A context
+ * switch scheduled with arch_trigger_pendsv is performed when leaving the
+ * kernel or an interrupt handler, like PendSV on Cortex-M3.
+ *
+ * The application provides main(), which calls rtos_init, as well as the
+ * hooks otherwise provided by the BSP. As a process may be switched out at
+ * any tick, processes must not share non-reentrant library state, such as
+ * stdio streams, without masking the tick signal.
+ *
+ * With several cores, RTOS_NBR_CORES, core 0 is the thread that calls
+ * rtos_init and arch_start creates one more thread per core. Each thread
+ * has its own signal mask and pending context switch, and runs the
+ * processes of its core. A process that migrates continues in the thread
+ * of its new core. The tick and the attached interrupt signals are taken by
+ * whichever core has them unblocked, but like with an interrupt controller,
+ * the handler of a signal runs on one core at a time. A core makes another
+ * core reschedule with a real-time signal sent to its thread, like an
+ * inter-processor interrupt.
+ *
+ *****************************************************************************/
+
+#include <errno.h>
+#if RTOS_NBR_CORES > 1
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <signal.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <ucontext.h>
+
+#include "rtos_types.h"
+#include "pcb.h"
+#include "kernel_int.h"
+#include "kernel_arch.h"
+
+/******************************************************************************
+ * Defines, constants and structs.
+ *****************************************************************************/
+
+/* Tick period in microseconds. */
+#ifndef RTOS_POSIX_TICK_US
+#define RTOS_POSIX_TICK_US 1000
+#endif
+
+/* The longest tickless sleep. */
+#define MAX_SLEEP_TICKS 100000
+
+/* The saved context of a process. It is placed at the top of the process'
+   stack and pointed out by the 'sp' field of the PCB. */
+typedef struct ProcessContext
+{
+      ucontext_t          context;
+
+      /* Return value of the syscall that the process is in. */
+      rtos_address        retval;
+} ProcessContext;
+
+typedef rtos_address (*SyscallHandler)(rtos_address, rtos_address,
+                                       rtos_address);
+
+
+/******************************************************************************
+ * External Functions
+ *****************************************************************************/
+extern void rtos_reschedule_hook(void);
+
+/******************************************************************************
+ * External Variables
+ */
+#if RTOS_NBR_CORES == 1
+extern PCB *current_pcb;
+extern PCB *new_pcb;
+#endif
+extern void *syscall_pointers[];
+
+/******************************************************************************
+ * Global Variables
+ */
+
+/* On target, the kernel pool starts after BSS, as set up by the linker
+   script. */
+rtos_address _kernel_pool_start[RTOS_POSIX_POOL_SIZE / sizeof(rtos_address)];
+
+/******************************************************************************
+ * Local Variables
+ */
+/* A context switch scheduled with arch_trigger_pendsv, per core. */
+static volatile sig_atomic_t pendsv_pending[RTOS_NBR_CORES];
+
+/* The signals emulating interrupts, SIGALRM and the attached ones, and
+   their handlers. */
+static sigset_t interrupt_signal_set;
+static int interrupt_signal_set_initialized = 0;
+static void (*interrupt_handlers[NSIG])(void);
+
+#if RTOS_NBR_CORES > 1
+/* The thread of each core, and the core of the calling thread. */
+static pthread_t core_threads[RTOS_NBR_CORES];
+static __thread rtos_u32 this_core = 0;
+
+/* Held while the handler of the signal runs on some core. */
+static volatile rtos_u32 interrupt_locks[NSIG];
+
+static void *core_start(void *core);
+#endif
+
+
+/******************************************************************************
+ * Function: context_switch
+ *
+ * The PendSV handler. Calls the portable kernel to reschedule and switches
+ * from current_pcb to new_pcb. Returns when the calling process is switched
+ * back in. The interrupt signals must be blocked.
+ */
+static void context_switch(void)
+{
+   ProcessContext *from = (ProcessContext *) current_pcb->sp;
+   ProcessContext *to = 0;
+
+   pendsv_pending[ARCH_CORE_ID()] = 0;
+#ifdef RTOS_CRITICAL_PROFILE
+   rtos_critical_profile_start();
+#endif
+#if RTOS_NBR_CORES > 1
+   rtos_kernel_lock();
+#endif
+   rtos_reschedule_hook();
+   to = (ProcessContext *) new_pcb->sp;
+   current_pcb = new_pcb;
+#ifdef RTOS_CRITICAL_PROFILE
+   rtos_critical_profile_stop(RTOS_CRITICAL_SITE_RESCHEDULE);
+#endif
+
+   if (from != to)
+   {
+      swapcontext(&from->context, &to->context);
+   }
+#if RTOS_NBR_CORES > 1
+   /* Back in the switched-out process, maybe on another core. */
+   rtos_kernel_unlock();
+#endif
+}
+
+
+/******************************************************************************
+ * Function: interrupt_call
+ *
+ * Calls the handler attached to an interrupt signal. With several cores, the
+ * handler of a signal that is already running on another core is waited
+ * for, so that it runs on one core at a time.
+ */
+static void interrupt_call(int signal_number)
+{
+#if RTOS_NBR_CORES > 1
+   posix_spin_lock(&interrupt_locks[signal_number]);
+   interrupt_handlers[signal_number]();
+   ARCH_SPIN_UNLOCK(&interrupt_locks[signal_number]);
+#else
+   interrupt_handlers[signal_number]();
+#endif
+}
+
+
+/******************************************************************************
+ * Function: interrupt_handler
+ *
+ * Signal handler for the interrupt signals. Calls the attached handler and
+ * performs a context switch that it scheduled. All signals are blocked while
+ * the handler runs.
+ */
+static void interrupt_handler(int signal_number)
+{
+   int saved_errno = errno;
+
+   interrupt_call(signal_number);
+   if (pendsv_pending[ARCH_CORE_ID()])
+   {
+      context_switch();
+   }
+
+   errno = saved_errno;
+}
+
+
+/******************************************************************************
+ * Function: interrupt_signal_add
+ *
+ * Adds a signal to the interrupt signals, blocks it in the calling thread
+ * and installs the handler.
+ */
+static void interrupt_signal_add(int signal_number, void (*handler)(void))
+{
+   struct sigaction action;
+   sigset_t signal_set;
+
+   if (!interrupt_signal_set_initialized)
+   {
+      sigemptyset(&interrupt_signal_set);
+      interrupt_signal_set_initialized = 1;
+   }
+   sigaddset(&interrupt_signal_set, signal_number);
+   sigemptyset(&signal_set);
+   sigaddset(&signal_set, signal_number);
+   sigprocmask(SIG_BLOCK, &signal_set, 0);
+
+   interrupt_handlers[signal_number] = handler;
+   action.sa_handler = interrupt_handler;
+   sigfillset(&action.sa_mask);
+   action.sa_flags = SA_RESTART;
+   sigaction(signal_number, &action, 0);
+}
+
+
+/******************************************************************************
+ * Function: posix_interrupt_attach
+ *
+ * Makes 'handler' the interrupt handler for the signal 'signal_number',
+ * which may then use the *_from_isr calls. May be called before rtos_init,
+ * e.g. from soc_start_hook, or from a process.
+ */
+void posix_interrupt_attach(int signal_number, void (*handler)(void))
+{
+   sigset_t all_signals;
+   sigset_t saved_mask;
+
+   if (signal_number <= 0 || signal_number >= NSIG ||
+       signal_number == SIGALRM)
+   {
+      abort();
+   }
+
+   sigfillset(&all_signals);
+   sigprocmask(SIG_BLOCK, &all_signals, &saved_mask);
+   interrupt_signal_add(signal_number, handler);
+
+   /* Before the kernel is started, the signal stays blocked. The first
+      process is started with all signals unblocked. */
+   if (current_pcb == 0)
+   {
+      sigaddset(&saved_mask, signal_number);
+   }
+   sigprocmask(SIG_SETMASK, &saved_mask, 0);
+}
+
+
+/******************************************************************************
+ * Function: process_start
+ *
+ * First function executed in the context of a new process. Calls the entry
+ * point of the process, which must never return. With several cores, the
+ * process starts with the kernel lock held and all signals blocked.
+ */
+static void process_start(void)
+{
+#if RTOS_NBR_CORES > 1
+   sigset_t no_signals;
+
+   rtos_kernel_unlock();
+   sigemptyset(&no_signals);
+   sigprocmask(SIG_SETMASK, &no_signals, 0);
+#endif
+   ((void (*)(void)) current_pcb->entry)();
+   abort();
+}
+
+
+/******************************************************************************
+ * Function: posix_syscall
+ *
+ * Called from the syscall stubs. Runs the portable syscall handler with
+ * the interrupt signals blocked and performs a pending context switch
+ * before returning. Returns the syscall return value, which may have been
+ * replaced by arch_store_retval while the process was switched out.
+ */
+rtos_address posix_syscall(rtos_u32 call_id, rtos_address arg0,
+                           rtos_address arg1, rtos_address arg2)
+{
+   ProcessContext *context = 0;
+   sigset_t saved_mask;
+   rtos_address retval = 0;
+
+   sigprocmask(SIG_BLOCK, &interrupt_signal_set, &saved_mask);
+
+   context = (ProcessContext *) current_pcb->sp;
+#ifdef RTOS_CRITICAL_PROFILE
+   rtos_critical_profile_start();
+#endif
+   context->retval =
+      ((SyscallHandler) syscall_pointers[call_id])(arg0, arg1, arg2);
+#ifdef RTOS_CRITICAL_PROFILE
+   /* The context switch is profiled on its own, as the process switched in
+      leaves the kernel from another place. */
+   rtos_critical_profile_stop(RTOS_CRITICAL_SITE_SYSCALL + call_id);
+#endif
+   if (pendsv_pending[ARCH_CORE_ID()])
+   {
+      context_switch();
+   }
+   retval = context->retval;
+
+   sigprocmask(SIG_SETMASK, &saved_mask, 0);
+   return retval;
+}
+
+
+/******************************************************************************
+ * Function: posix_interrupt_mask_all
+ */
+void posix_interrupt_mask_all(void)
+{
+   sigprocmask(SIG_BLOCK, &interrupt_signal_set, 0);
+}
+
+
+/******************************************************************************
+ * Function: posix_interrupt_unmask_all
+ *
+ * Performs a context switch that was scheduled while masked, then unmasks
+ * the interrupt signals.
+ */
+void posix_interrupt_unmask_all(void)
+{
+   if (pendsv_pending[ARCH_CORE_ID()])
+   {
+      context_switch();
+   }
+   sigprocmask(SIG_UNBLOCK, &interrupt_signal_set, 0);
+}
+
+
+/******************************************************************************
+ * Function: posix_wait_for_interrupt
+ */
+void posix_wait_for_interrupt(void)
+{
+   sigset_t no_signals;
+
+   sigemptyset(&no_signals);
+   sigsuspend(&no_signals);
+}
+
+
+/******************************************************************************
+ * Function: posix_timestamp
+ *
+ * Returns the host's monotonic clock in nanoseconds, truncated to 32 bits.
+ */
+rtos_u32 posix_timestamp(void)
+{
+   struct timespec now;
+
+   clock_gettime(CLOCK_MONOTONIC, &now);
+   return (rtos_u32) now.tv_sec * 1000000000u + (rtos_u32) now.tv_nsec;
+}
+
+
+/******************************************************************************
+ * Function: arch_init_stack
+ *
+ * Places a ProcessContext at the top of the process' stack and prepares it
+ * so that switching to it starts the process from its entrypoint.
+ */
+void arch_init_stack(PCB *pcb)
+{
+   rtos_address stack_base = pcb->thread_stack_top - pcb->stack_size;
+   rtos_address context_address =
+      (pcb->thread_stack_top - sizeof(ProcessContext)) & ~(rtos_address) 15;
+   ProcessContext *context = (ProcessContext *) context_address;
+
+   getcontext(&context->context);
+   context->context.uc_stack.ss_sp = (void *) stack_base;
+   context->context.uc_stack.ss_size = context_address - stack_base;
+   context->context.uc_link = 0;
+#if RTOS_NBR_CORES > 1
+   /* Unblocked by process_start, after releasing the kernel lock. */
+   sigfillset(&context->context.uc_sigmask);
+#else
+   sigemptyset(&context->context.uc_sigmask);
+#endif
+   makecontext(&context->context, process_start, 0);
+   context->retval = 0;
+
+   pcb->sp = context_address;
+}
+
+
+/******************************************************************************
+ * Function: arch_start
+ *
+ * Installs the tick signal handler, starts the periodic tick and switches
+ * to the process pointed out by 'pcb'. Never returns.
+ *
+ * Parameters:
+ *  pcb - The first process to execute in the OS.
+ */
+void arch_start(PCB *pcb)
+{
+   struct itimerval timer;
+#if RTOS_NBR_CORES > 1
+   rtos_u32 core = 0;
+#endif
+
+   interrupt_signal_add(SIGALRM, rtos_tick_hook);
+#if RTOS_NBR_CORES > 1
+   interrupt_signal_add(SIGRTMIN, arch_trigger_pendsv);
+
+   /* The threads start with the interrupt signals blocked, like this one. */
+   core_threads[0] = pthread_self();
+   for (core = 1; core < RTOS_NBR_CORES; core++)
+   {
+      if (pthread_create(&core_threads[core], 0, core_start,
+                         (void *) (rtos_address) core) != 0)
+      {
+         abort();
+      }
+   }
+   rtos_kernel_lock();
+#endif
+
+   timer.it_interval.tv_sec = RTOS_POSIX_TICK_US / 1000000;
+   timer.it_interval.tv_usec = RTOS_POSIX_TICK_US % 1000000;
+   timer.it_value = timer.it_interval;
+   setitimer(ITIMER_REAL, &timer, 0);
+
+   /* The process' signal mask, with the interrupt signals unblocked, is
+      restored too. */
+   setcontext(&((ProcessContext *) pcb->sp)->context);
+}
+
+
+/******************************************************************************
+ * Function: arch_trigger_pendsv
+ *
+ * Schedules a context switch when leaving the kernel.
+ */
+void arch_trigger_pendsv(void)
+{
+   pendsv_pending[ARCH_CORE_ID()] = 1;
+}
+
+
+#if RTOS_NBR_CORES > 1
+/******************************************************************************
+ * Function: arch_kick_core
+ *
+ * Sends the inter-processor interrupt signal to the thread of 'core'. If the
+ * core has it blocked, it is taken when the core leaves the kernel.
+ */
+void arch_kick_core(rtos_u32 core)
+{
+   pthread_kill(core_threads[core], SIGRTMIN);
+}
+
+
+/******************************************************************************
+ * Function: posix_core_id
+ *
+ * Returns the core of the calling thread. Not inlined, as a process may
+ * continue in another thread after a context switch, and the address of
+ * the thread-local variable must then be taken again.
+ */
+__attribute__((noinline)) rtos_u32 posix_core_id(void)
+{
+   return this_core;
+}
+
+
+/******************************************************************************
+ * Function: posix_spin_lock
+ *
+ * Takes a spinlock. As the thread that holds it may have been preempted by
+ * the host, the host is let run other threads while the lock is taken.
+ */
+void posix_spin_lock(volatile rtos_u32 *lock)
+{
+   while (__atomic_exchange_n(lock, 1, __ATOMIC_ACQUIRE) != 0)
+   {
+      while (__atomic_load_n(lock, __ATOMIC_RELAXED) != 0)
+      {
+         sched_yield();
+      }
+   }
+}
+
+
+/******************************************************************************
+ * Function: core_start
+ *
+ * Thread function of the cores other than core 0. Starts the first process
+ * of the core, from rtos_current_pcbs. Never returns.
+ */
+static void *core_start(void *core)
+{
+   this_core = (rtos_u32) (rtos_address) core;
+   rtos_kernel_lock();
+   setcontext(&((ProcessContext *) current_pcb->sp)->context);
+   abort();
+   return 0;
+}
+#endif
+
+
+/******************************************************************************
+ * Function: arch_store_retval
+ *
+ * Sets the value that the process described by 'pcb' returns from its
+ * current syscall with.
+ */
+void arch_store_retval(rtos_address retval, PCB *pcb)
+{
+   ((ProcessContext *) pcb->sp)->retval = retval;
+}
+
+
+#ifdef RTOS_TICKLESS_IDLE
+/******************************************************************************
+ * Function: arch_tickless_sleep
+ *
+ * Delays the next SIGALRM until the end of tick period number 'max_ticks',
+ * counted from the last tick, and waits for it with SIGALRM blocked. The
+ * interval timer keeps its period, so the periodic tick continues in phase
+ * afterwards. The signal is consumed here, so all ticks are returned as
+ * elapsed. If another interrupt signal comes first, its handler is called
+ * from here, and the tick is moved back to the end of the current period.
+ * The timer may expire while it is being read and modified; as Linux only
+ * reloads it when SIGALRM is taken, the pending signal is checked after
+ * each read. Called with the interrupt signals blocked.
+ *
+ * Parameters:
+ *  max_ticks - Maximum number of ticks to sleep, 0 meaning no limit.
+ */
+rtos_u32 arch_tickless_sleep(rtos_u32 max_ticks)
+{
+   struct itimerval timer;
+   sigset_t pending;
+   long sleep_us = 0;
+   long remaining_us = 0;
+   rtos_u32 remaining_ticks = 0;
+   int signal_number = 0;
+
+   if (max_ticks == 0 || max_ticks > MAX_SLEEP_TICKS)
+   {
+      max_ticks = MAX_SLEEP_TICKS;
+   }
+
+   /* If the tick already happened, just report it. The timer is read
+      first, so that a tick between the two is seen here. */
+   getitimer(ITIMER_REAL, &timer);
+   remaining_us = timer.it_value.tv_sec * 1000000L + timer.it_value.tv_usec;
+   sigpending(&pending);
+   if (sigismember(&pending, SIGALRM))
+   {
+      sigemptyset(&pending);
+      sigaddset(&pending, SIGALRM);
+      sigwait(&pending, &signal_number);
+      return 1;
+   }
+
+   if (max_ticks > 1)
+   {
+      sleep_us = remaining_us + (long) (max_ticks - 1) * RTOS_POSIX_TICK_US;
+      timer.it_value.tv_sec = sleep_us / 1000000L;
+      timer.it_value.tv_usec = sleep_us % 1000000L;
+      setitimer(ITIMER_REAL, &timer, 0);
+
+      /* If the timer expired since it was read, the delay is one period too
+         long. Let the timer expire at the end of the current period
+         instead and report the tick that is pending. */
+      sigpending(&pending);
+      if (sigismember(&pending, SIGALRM))
+      {
+         getitimer(ITIMER_REAL, &timer);
+         remaining_us = timer.it_value.tv_sec * 1000000L
+            + timer.it_value.tv_usec
+            - (long) (max_ticks - 2) * RTOS_POSIX_TICK_US;
+         timer.it_value.tv_sec = remaining_us / 1000000L;
+         timer.it_value.tv_usec = remaining_us % 1000000L;
+         setitimer(ITIMER_REAL, &timer, 0);
+         sigemptyset(&pending);
+         sigaddset(&pending, SIGALRM);
+         sigwait(&pending, &signal_number);
+         return 1;
+      }
+   }
+
+   sigwait(&interrupt_signal_set, &signal_number);
+   if (signal_number == SIGALRM)
+   {
+      return max_ticks;
+   }
+
+   /* Woken by another interrupt. Its signal was consumed, so handle it
+      here. */
+   interrupt_call(signal_number);
+
+   getitimer(ITIMER_REAL, &timer);
+   remaining_us = timer.it_value.tv_sec * 1000000L + timer.it_value.tv_usec;
+   sigpending(&pending);
+   if (sigismember(&pending, SIGALRM))
+   {
+      sigemptyset(&pending);
+      sigaddset(&pending, SIGALRM);
+      sigwait(&pending, &signal_number);
+      return max_ticks;
+   }
+
+   /* Count the tick periods that elapsed and let the timer expire at the
+      end of the current one. */
+   remaining_ticks =
+      (rtos_u32) ((remaining_us + RTOS_POSIX_TICK_US - 1) / RTOS_POSIX_TICK_US);
+   if (remaining_ticks > 1)
+   {
+      remaining_us -= (long) (remaining_ticks - 1) * RTOS_POSIX_TICK_US;
+      timer.it_value.tv_sec = remaining_us / 1000000L;
+      timer.it_value.tv_usec = remaining_us % 1000000L;
+      setitimer(ITIMER_REAL, &timer, 0);
+   }
+
+   return max_ticks - remaining_ticks;
+}
+#endif
@@ -0,0 +1,350 @@
+/*****************************************************************************
+ * smp_stress.c - Stress test of the multi-core kernel on the posix
+ * architecture, where each core is a host thread.
+ *
+ * Every core runs a producer, which sends numbered messages of varying sizes
+ * to the consumer on the next core, and a consumer, which checks that they
+ * arrive complete and in order. Every other producer sends its messages in
+ * batches, which the consumer drains. Migrators move between the cores for every
+ * round, check that they continue on the core they asked for, and count
+ * their rounds in a counter shared by all of them under a mutex. When all
+ * workers have set their bit in an event group, the checker compares the
+ * counts and exits with status 0 if they are right.
+ *
+ * Build the kernel with NBR_CORES > 1, preferably with CHECK_LEVEL 2 to run
+ * the kernel audit in the idle processes meanwhile.
+ *
+ *****************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rtos_types.h"
+#include "kernel.h"
+#include "pcb.h"
+
+/******************************************************************************
+ * External Functions
+ *****************************************************************************/
+extern void rtos_init(void);
+
+/******************************************************************************
+ * Defines
+ *****************************************************************************/
+
+#ifndef STRESS_ROUNDS
+#define STRESS_ROUNDS 20000
+#endif
+
+#define STACK_SIZE 32768
+#define NBR_MIGRATORS 4
+
+/* The producer waits for an ack from the consumer after every window of
+   messages, so that the inbox stays bounded. */
+#define WINDOW 16
+
+/* Consumers receive with a timeout, to exercise timeouts racing with sends
+   from other cores. */
+#define RECEIVE_TIMEOUT 2
+
+#define MESSAGE_INBOX 0
+
+/* Producers with an odd index send batches, see producer. */
+#define BATCHED(producer) (((producer) & 1) != 0)
+
+/* Message sizes, spread over the buffer pools, at least the size of a
+   StressMessage. */
+#define NBR_SIZES 3
+static const rtos_u32 sizes[NBR_SIZES] = { 16, 48, 300 };
+
+/******************************************************************************
+ * Types
+ *****************************************************************************/
+
+typedef struct
+{
+   rtos_u32 producer;
+   rtos_u32 sequence;
+   rtos_u32 size;
+   rtos_u32 check;
+} StressMessage;
+
+/******************************************************************************
+ * Variables
+ *****************************************************************************/
+
+static rtos_u32 producer_pids[RTOS_NBR_CORES];
+static rtos_u32 consumer_pids[RTOS_NBR_CORES];
+static rtos_u32 migrator_pids[NBR_MIGRATORS];
+static rtos_u32 done_group = 0;
+static rtos_u32 counter_mutex = 0;
+
+/* Updated under 'counter_mutex' only. */
+static volatile rtos_u32 shared_rounds = 0;
+
+/* Written by one process each. */
+static volatile rtos_u32 received[RTOS_NBR_CORES];
+static volatile rtos_u32 timeouts[RTOS_NBR_CORES];
+static volatile rtos_u32 migrations[NBR_MIGRATORS];
+static volatile rtos_u32 failures = 0;
+static volatile const char *failure = 0;
+
+/******************************************************************************
+ * Functions
+ *****************************************************************************/
+
+static void fail(const char *what)
+{
+   failure = what;
+   failures++;
+}
+
+static rtos_u32 my_index(const rtos_u32 *pids)
+{
+   rtos_u32 pid = rtos_current_pid();
+   rtos_u32 index = 0;
+
+   while (pids[index] != pid)
+   {
+      index++;
+   }
+   return index;
+}
+
+static void producer(void)
+{
+   rtos_u32 index = my_index(producer_pids);
+   rtos_destination dest = { consumer_pids[(index + 1) % RTOS_NBR_CORES],
+                             MESSAGE_INBOX };
+   rtos_address batch[WINDOW];
+   rtos_u32 batched = 0;
+   rtos_u32 sequence = 0;
+   StressMessage *message = 0;
+
+   for (sequence = 0; sequence < STRESS_ROUNDS; sequence++)
+   {
+      rtos_u32 size = sizes[sequence % NBR_SIZES];
+
+      if (rtos_current_core() != index)
+      {
+         fail("producer on wrong core");
+      }
+
+      message = (StressMessage *) rtos_alloc(size);
+      if (message == 0)
+      {
+         fail("producer out of buffers");
+         break;
+      }
+      message->producer = index;
+      message->sequence = sequence;
+      message->size = size;
+      memset((char *) message + sizeof(StressMessage),
+             (int) (sequence & 0xFF), size - sizeof(StressMessage));
+      message->check = index ^ sequence ^ 0x5A5A5A5Au;
+
+      /* Every other producer sends its window as one batch. */
+      if (BATCHED(index))
+      {
+         batch[batched++] = (rtos_address) message;
+         if (batched == WINDOW || sequence + 1 == STRESS_ROUNDS)
+         {
+            rtos_send_batch(batch, batched, &dest);
+            batched = 0;
+         }
+      }
+      else
+      {
+         rtos_send((rtos_address) message, dest.pid, dest.inbox);
+      }
+
+      if ((sequence + 1) % WINDOW == 0)
+      {
+         rtos_wait_psem();
+      }
+   }
+
+   rtos_event_set(done_group, 1u << index);
+   for (;;)
+   {
+      rtos_delay(1000);
+   }
+}
+
+static void check_message(StressMessage *message, rtos_u32 source,
+                          rtos_u32 expected)
+{
+   rtos_u32 offset = 0;
+
+   if (message->producer != source || message->sequence != expected ||
+       message->size != sizes[expected % NBR_SIZES] ||
+       message->check != (source ^ expected ^ 0x5A5A5A5Au))
+   {
+      fail("message out of order or corrupt");
+   }
+   for (offset = sizeof(StressMessage); offset < message->size; offset++)
+   {
+      if (((unsigned char *) message)[offset] != (expected & 0xFF))
+      {
+         fail("message payload corrupt");
+         break;
+      }
+   }
+}
+
+static void consumer(void)
+{
+   rtos_u32 index = my_index(consumer_pids);
+   rtos_u32 source = (index + RTOS_NBR_CORES - 1) % RTOS_NBR_CORES;
+   rtos_u32 expected = 0;
+   rtos_address messages[WINDOW];
+   rtos_u32 nbr_messages = 0;
+   rtos_u32 message = 0;
+
+   while (expected < STRESS_ROUNDS)
+   {
+      /* The messages of a batching producer are drained. */
+      if (BATCHED(source))
+      {
+         nbr_messages = rtos_receive_all(MESSAGE_INBOX, messages, WINDOW);
+      }
+      else
+      {
+         messages[0] = rtos_receive_timeout(MESSAGE_INBOX, RECEIVE_TIMEOUT);
+         nbr_messages = messages[0] != 0;
+         if (nbr_messages == 0)
+         {
+            timeouts[index]++;
+         }
+      }
+
+      for (message = 0; message < nbr_messages; message++)
+      {
+         check_message((StressMessage *) messages[message], source,
+                       expected);
+         rtos_dispose(messages[message]);
+         expected++;
+         received[index] = expected;
+
+         if (expected % WINDOW == 0)
+         {
+            rtos_signal_psem(producer_pids[source]);
+         }
+      }
+   }
+
+   rtos_event_set(done_group, 1u << (RTOS_NBR_CORES + index));
+   for (;;)
+   {
+      rtos_delay(1000);
+   }
+}
+
+static void migrator(void)
+{
+   rtos_u32 index = my_index(migrator_pids);
+   rtos_u32 round = 0;
+   rtos_u32 core = 0;
+
+   for (round = 0; round < STRESS_ROUNDS / 4; round++)
+   {
+      core = (rtos_current_core() + 1 + round % 3) % RTOS_NBR_CORES;
+      rtos_migrate(core);
+      if (rtos_current_core() != core)
+      {
+         fail("migrator on wrong core");
+      }
+      migrations[index]++;
+
+      rtos_mutex_lock(counter_mutex);
+      shared_rounds = shared_rounds + 1;
+      rtos_mutex_unlock(counter_mutex);
+
+      if (round % 64 == 0)
+      {
+         rtos_delay(1);
+      }
+   }
+
+   rtos_event_set(done_group, 1u << (2 * RTOS_NBR_CORES + index));
+   for (;;)
+   {
+      rtos_delay(1000);
+   }
+}
+
+static void checker(void)
+{
+   rtos_u32 all = (1u << (2 * RTOS_NBR_CORES + NBR_MIGRATORS)) - 1;
+   rtos_u32 index = 0;
+   rtos_u32 total_timeouts = 0;
+   rtos_u32 total_migrations = 0;
+   char text[200];
+   int length = 0;
+
+   rtos_event_wait(done_group, all, RTOS_EVENT_WAIT_ALL);
+
+   for (index = 0; index < RTOS_NBR_CORES; index++)
+   {
+      if (received[index] != STRESS_ROUNDS)
+      {
+         fail("messages lost");
+      }
+      total_timeouts += timeouts[index];
+   }
+   for (index = 0; index < NBR_MIGRATORS; index++)
+   {
+      total_migrations += migrations[index];
+   }
+   if (shared_rounds != total_migrations ||
+       total_migrations != NBR_MIGRATORS * (STRESS_ROUNDS / 4))
+   {
+      fail("shared counter mismatch");
+   }
+
+   length = snprintf(text, sizeof(text),
+                     "cores %d messages %u timeouts %u migrations %u "
+                     "shared %u: %s\n",
+                     RTOS_NBR_CORES, RTOS_NBR_CORES * STRESS_ROUNDS,
+                     total_timeouts, total_migrations, shared_rounds,
+                     failures == 0 ? "PASS" : (const char *) failure);
+   write(STDOUT_FILENO, text, length);
+   exit(failures == 0 ? 0 : 1);
+}
+
+void rtos_hook_create_processes(void)
+{
+   rtos_u32 core = 0;
+   rtos_u32 index = 0;
+
+   counter_mutex = rtos_create_mutex();
+   done_group = rtos_create_event_group();
+
+   for (core = 0; core < RTOS_NBR_CORES; core++)
+   {
+      producer_pids[core] = rtos_create_process_on_core(
+         (rtos_address) producer, STACK_SIZE, 3, core);
+      consumer_pids[core] = rtos_create_process_on_core(
+         (rtos_address) consumer, STACK_SIZE, 2, core);
+   }
+
+   for (index = 0; index < NBR_MIGRATORS; index++)
+   {
+      migrator_pids[index] = rtos_create_process_on_core(
+         (rtos_address) migrator, STACK_SIZE, 4, index % RTOS_NBR_CORES);
+   }
+
+   rtos_create_process((rtos_address) checker, STACK_SIZE, 1);
+}
+
+void soc_start_hook(void)
+{
+}
+
+int main(void)
+{
+   rtos_init();
+   return 1;
+}
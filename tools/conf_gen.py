@@ -0,0 +1,309 @@
+#!/usr/bin/env python3
+###############################################################################
+# conf_gen.py - Generates the static kernel configuration, the tables in
+# include/rtos_static.h, from a description of the processes, mutexes,
+# event groups and preallocated buffers of an application. Used with
+# STATIC_CONFIG in config.mk, from the conf_gen rule of the application,
+# through CONF_GEN in build/kernel_config.mk.
+#
+# The description has one item per line. '#' starts a comment.
+#
+#   process      <name> <entry> <stack size> <priority> [<core>]
+#   mutex        <name>
+#   event_group  <name>
+#   pool         <buffer size> <number of buffers>
+#
+# Processes get pids in the order they are listed, and likewise mutexes and
+# event groups get ids. A process runs on core 0 unless a core is given.
+# The idle processes, one per core, are added last, and with --work-queues
+# the kernel's work process just before them. A pool preallocates
+# buffers of one of the sizes in BUFFER_SIZES. The entry functions must be
+# global functions of the application.
+#
+# The output is <output>.c, with the tables, and <output>.h, which defines
+# <NAME>_PID, <NAME>_MUTEX and <NAME>_EVENT_GROUP for the application,
+# IDLE_PID, the pid of the idle process of core 0, and WORK_PID, the pid of
+# the work process, if there is one.
+###############################################################################
+
+import argparse
+import os
+import re
+import sys
+
+IDENTIFIER = re.compile(r"^[A-Za-z_][A-Za-z0-9_]*$")
+MAX_STACK_SIZE = 0xFFF8
+
+
+class ConfError(Exception):
+    """An error in the description, with the line it was found on."""
+
+
+def parse_int(text, line_nbr):
+    """Returns the integer in 'text', decimal or 0x-prefixed hex."""
+    try:
+        return int(text, 0)
+    except ValueError:
+        raise ConfError("line %d: '%s' is not a number" % (line_nbr, text))
+
+
+def parse_name(text, names, line_nbr):
+    """Checks that 'text' is a new C identifier and adds it to 'names'."""
+    if not IDENTIFIER.match(text):
+        raise ConfError("line %d: '%s' is not a valid name" % (line_nbr, text))
+    if text in names:
+        raise ConfError("line %d: '%s' is already defined" % (line_nbr, text))
+    names.add(text)
+    return text
+
+
+def parse(lines, options):
+    """Returns the processes, mutexes, event groups and pool counts."""
+    processes = []
+    mutexes = []
+    event_groups = []
+    pools = dict((size, 0) for size in options.buffer_sizes)
+    pools_seen = set()
+    names = {"process": set(), "mutex": set(), "event_group": set()}
+
+    for line_nbr, line in enumerate(lines, 1):
+        fields = line.split("#", 1)[0].split()
+        if not fields:
+            continue
+        kind, args = fields[0], fields[1:]
+
+        if kind == "process":
+            if len(args) not in (4, 5):
+                raise ConfError("line %d: expected process <name> <entry> "
+                                "<stack size> <priority> [<core>]" % line_nbr)
+            name = parse_name(args[0], names["process"], line_nbr)
+            if not IDENTIFIER.match(args[1]):
+                raise ConfError("line %d: '%s' is not a valid entry"
+                                % (line_nbr, args[1]))
+            stack_size = parse_int(args[2], line_nbr)
+            priority = parse_int(args[3], line_nbr)
+            core = parse_int(args[4], line_nbr) if len(args) == 5 else 0
+            if stack_size <= 0 or stack_size > MAX_STACK_SIZE or \
+               stack_size % 8 != 0:
+                raise ConfError("line %d: stack size must be a multiple of 8 "
+                                "up to %d" % (line_nbr, MAX_STACK_SIZE))
+            if priority < 0 or priority >= options.nbr_priorities - 1:
+                raise ConfError("line %d: priority must be 0-%d, the lowest "
+                                "is for idle"
+                                % (line_nbr, options.nbr_priorities - 2))
+            if core < 0 or core >= options.nbr_cores:
+                raise ConfError("line %d: core must be 0-%d"
+                                % (line_nbr, options.nbr_cores - 1))
+            processes.append((name, args[1], stack_size, priority, core))
+        elif kind == "mutex" or kind == "event_group":
+            if len(args) != 1:
+                raise ConfError("line %d: expected %s <name>"
+                                % (line_nbr, kind))
+            name = parse_name(args[0], names[kind], line_nbr)
+            (mutexes if kind == "mutex" else event_groups).append(name)
+        elif kind == "pool":
+            if len(args) != 2:
+                raise ConfError("line %d: expected pool <buffer size> "
+                                "<number of buffers>" % line_nbr)
+            size = parse_int(args[0], line_nbr)
+            count = parse_int(args[1], line_nbr)
+            if size not in pools:
+                raise ConfError("line %d: %d is not one of the BUFFER_SIZES"
+                                % (line_nbr, size))
+            if size in pools_seen:
+                raise ConfError("line %d: pool %d is already defined"
+                                % (line_nbr, size))
+            if count < 0:
+                raise ConfError("line %d: negative number of buffers"
+                                % line_nbr)
+            pools_seen.add(size)
+            pools[size] = count
+        else:
+            raise ConfError("line %d: unknown item '%s'" % (line_nbr, kind))
+
+    return processes, mutexes, event_groups, pools
+
+
+def object_table(type_name, objects, map_name, names):
+    """Returns the C lines for kernel objects of 'type_name' and their map.
+    An empty map gets one null entry, as C has no empty arrays."""
+    lines = []
+    if names:
+        lines.append("static %s %s[%d];" % (type_name, objects, len(names)))
+        lines.append("")
+    lines.append("%s *const %s[] =" % (type_name, map_name))
+    lines.append("{")
+    if names:
+        lines.append(",\n".join("   &%s[%d]" % (objects, index)
+                                for index in range(len(names))))
+    else:
+        lines.append("   0")
+    lines.append("};")
+    return lines
+
+
+def generate_c(source, header, processes, mutexes, event_groups, pools,
+               options):
+    """Returns the generated C file."""
+    lines = ["/* Generated by tools/conf_gen.py from %s. Do not edit. */"
+             % source,
+             "",
+             '#include "rtos_static.h"',
+             '#include "%s"' % header,
+             ""]
+
+    for entry in sorted(set(process[1] for process in processes)):
+        lines.append("extern void %s(void);" % entry)
+    lines.append("")
+
+    lines.append("/* Stacks, 8-byte aligned. */")
+    for name, entry, stack_size, priority, core in processes:
+        lines.append("static rtos_u64 stack_%s[%d];" % (name, stack_size // 8))
+    if options.work_queues > 0:
+        lines.append("static rtos_u64 work_stack[%d];"
+                     % ((options.work_stack_size + 7) // 8))
+    lines.append("static rtos_u64 idle_stacks[%d][%d];"
+                 % (options.nbr_cores, (options.idle_stack_size + 7) // 8))
+    lines.append("")
+
+    nbr_processes = (len(processes) + (options.work_queues > 0) +
+                     options.nbr_cores)
+    lines.append("static PCB pcbs[%d];" % nbr_processes)
+    lines.append("")
+    lines.append("const rtos_u32 rtos_static_nbr_processes = %d;"
+                 % nbr_processes)
+    lines.append("")
+    lines.append("const RtosStaticProcess rtos_static_processes[] =")
+    lines.append("{")
+    entries = ["   { (rtos_address) %s, (rtos_address) stack_%s, %d, %d, %d }"
+               % (entry, name, stack_size, priority, core)
+               for name, entry, stack_size, priority, core in processes]
+    if options.work_queues > 0:
+        entries.append("   { 0, (rtos_address) work_stack, %d, %d, 0 }"
+                       % (options.work_stack_size, options.work_priority))
+    entries.extend("   { 0, (rtos_address) idle_stacks[%d], %d, 0, %d }"
+                   % (core, options.idle_stack_size, core)
+                   for core in range(options.nbr_cores))
+    lines.append(",\n".join(entries))
+    lines.append("};")
+    lines.append("")
+    lines.append("PCB *const rtos_static_pid_map[] =")
+    lines.append("{")
+    lines.append(",\n".join("   &pcbs[%d]" % pid
+                            for pid in range(nbr_processes)))
+    lines.append("};")
+    lines.append("")
+
+    lines.append("const rtos_u32 rtos_static_nbr_mutexes = %d;"
+                 % len(mutexes))
+    lines.append("")
+    lines.extend(object_table("Mutex", "mutexes", "rtos_static_mutex_map",
+                              mutexes))
+    lines.append("")
+    lines.append("const rtos_u32 rtos_static_nbr_event_groups = %d;"
+                 % len(event_groups))
+    lines.append("")
+    lines.extend(object_table("EventGroup", "event_groups",
+                              "rtos_static_event_group_map", event_groups))
+    lines.append("")
+
+    lines.append("/* Preallocated buffers. */")
+    for size in options.buffer_sizes:
+        if pools[size] > 0:
+            lines.append("static rtos_u64 pool_%d[(%d * "
+                         "RTOS_STATIC_BUFFER_BYTES(%d) + 7) / 8];"
+                         % (size, pools[size], size))
+    lines.append("")
+    lines.append("const rtos_u32 rtos_static_nbr_pools = %d;"
+                 % len(options.buffer_sizes))
+    lines.append("")
+    lines.append("const RtosStaticPool rtos_static_pools[] =")
+    lines.append("{")
+    lines.append(",\n".join(
+        "   { %d, %d, (rtos_address) pool_%d }" % (size, pools[size], size)
+        if pools[size] > 0 else "   { %d, 0, 0 }" % size
+        for size in options.buffer_sizes))
+    lines.append("};")
+    return "\n".join(lines) + "\n"
+
+
+def generate_h(source, guard, processes, mutexes, event_groups, options):
+    """Returns the generated header with the pids and ids."""
+    lines = ["/* Generated by tools/conf_gen.py from %s. Do not edit. */"
+             % source,
+             "",
+             "#ifndef %s" % guard,
+             "#define %s" % guard,
+             ""]
+    for pid, process in enumerate(processes):
+        lines.append("#define %s_PID %d" % (process[0].upper(), pid))
+    if options.work_queues > 0:
+        lines.append("#define WORK_PID %d" % len(processes))
+    lines.append("#define IDLE_PID %d"
+                 % (len(processes) + (options.work_queues > 0)))
+    for kind, names in (("MUTEX", mutexes), ("EVENT_GROUP", event_groups)):
+        if names:
+            lines.append("")
+        for index, name in enumerate(names):
+            lines.append("#define %s_%s %d" % (name.upper(), kind, index))
+    lines.append("")
+    lines.append("#endif")
+    return "\n".join(lines) + "\n"
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Generate the static kernel configuration.")
+    parser.add_argument("description", help="application description file")
+    parser.add_argument("-o", "--output", required=True,
+                        help="output path without extension, .c and .h "
+                        "are added")
+    parser.add_argument("--buffer-sizes", required=True,
+                        help="BUFFER_SIZES from config.mk")
+    parser.add_argument("--nbr-priorities", type=int, required=True,
+                        help="NBR_PRIORITIES from config.mk")
+    parser.add_argument("--idle-stack-size", type=int, required=True,
+                        help="IDLE_STACK_SIZE from config.mk")
+    parser.add_argument("--nbr-cores", type=int, default=1,
+                        help="NBR_CORES from config.mk")
+    parser.add_argument("--work-queues", type=int, default=0,
+                        help="WORK_QUEUES from config.mk")
+    parser.add_argument("--work-priority", type=int, default=0,
+                        help="WORK_PRIORITY from config.mk")
+    parser.add_argument("--work-stack-size", type=int, default=0,
+                        help="WORK_STACK_SIZE from config.mk")
+    options = parser.parse_args()
+    options.buffer_sizes = [int(size) for size in
+                            options.buffer_sizes.split(",")]
+    if options.work_queues > 0 and \
+       (options.work_stack_size <= 0 or
+        options.work_stack_size > MAX_STACK_SIZE or
+        options.work_stack_size % 8 != 0):
+        sys.exit("work stack size must be a multiple of 8 up to %d"
+                 % MAX_STACK_SIZE)
+
+    with open(options.description) as description:
+        lines = description.readlines()
+
+    try:
+        processes, mutexes, event_groups, pools = parse(lines, options)
+    except ConfError as error:
+        sys.exit("%s: %s" % (options.description, error))
+
+    source = os.path.basename(options.description)
+    base = os.path.basename(options.output)
+    guard = re.sub(r"[^A-Za-z0-9]", "_", base).upper() + "_H"
+
+    output_dir = os.path.dirname(options.output)
+    if output_dir:
+        os.makedirs(output_dir, exist_ok=True)
+    with open(options.output + ".c", "w") as output:
+        output.write(generate_c(source, base + ".h", processes, mutexes,
+                                event_groups, pools, options))
+    with open(options.output + ".h", "w") as output:
+        output.write(generate_h(source, guard, processes, mutexes,
+                                event_groups, options))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,205 @@
+#!/usr/bin/env python3
+###############################################################################
+# trace2chrome.py - Converts a dump of the kernel trace buffer, rtos_trace,
+# to Chrome trace event JSON, which can be opened in chrome://tracing or
+# the Perfetto UI.
+#
+# The dump is the raw memory of rtos_trace, e.g. from gdb:
+#
+#   dump binary value trace.bin rtos_trace
+#
+# Each process becomes a thread in the timeline. The time that a process
+# runs is shown as slices, taken from the context switch records, and the
+# other kernel events as instant events on the thread of the process that
+# they concern. The layout of the buffer is described in
+# include/rtos_trace.h.
+###############################################################################
+
+import argparse
+import json
+import struct
+import sys
+
+TRACE_MAGIC = 0x52545452
+TRACE_VERSION = 1
+HEADER_FORMAT = "IHHIII"
+RECORD_FORMAT = "IBBH"
+
+EVENT_SWITCH = 1
+NO_PID = 0xFF  # Interrupt handlers, in the pid field of ALLOC and DISPOSE.
+EVENT_NAMES = {
+    1: "switch",
+    2: "send",
+    3: "receive",
+    4: "receive_wait",
+    5: "alloc",
+    6: "dispose",
+    7: "delay",
+    8: "tick_wakeup",
+    9: "psem_wait",
+    10: "psem_signal",
+    11: "mutex_lock",
+    12: "mutex_unlock",
+    13: "priority",
+    14: "event_wait",
+    15: "event_set",
+    16: "timeout",
+}
+
+
+def event_args(event, arg):
+    """Returns the arguments of an event as a dictionary."""
+    name = EVENT_NAMES.get(event)
+    if name == "send":
+        return {"dest_pid": arg & 0xFF, "inbox": arg >> 8}
+    if name == "receive":
+        return {"inbox": arg}
+    if name == "receive_wait":
+        return {"inbox_mask": hex(arg)}
+    if name == "alloc":
+        return {"size": arg}
+    if name == "dispose":
+        return {"pool": arg}
+    if name == "delay":
+        return {"ticks": arg}
+    if name == "tick_wakeup":
+        return {"tick": arg}
+    if name == "psem_wait":
+        return {"blocks": bool(arg)}
+    if name == "psem_signal":
+        return {"woken": bool(arg)}
+    if name == "mutex_lock":
+        return {"owner": None if arg == 0xFFFF else arg}
+    if name == "mutex_unlock":
+        return {"new_owner": None if arg == 0xFFFF else arg}
+    if name == "priority":
+        return {"priority": arg}
+    if name == "event_wait":
+        return {"blocks": bool(arg)}
+    if name == "event_set":
+        return {"woken": arg}
+    if name == "timeout":
+        return {"state": arg}
+    return {"arg": arg}
+
+
+def read_trace(data, endian):
+    """Returns the header fields and the records, oldest first."""
+    header_format = endian + HEADER_FORMAT
+    record_format = endian + RECORD_FORMAT
+    header_size = struct.calcsize(header_format)
+    if len(data) < header_size:
+        raise ValueError("dump is shorter than the trace header")
+
+    (magic, version, record_size, nbr_records, timestamp_hz,
+     write_count) = struct.unpack_from(header_format, data)
+    if magic != TRACE_MAGIC:
+        raise ValueError("bad magic 0x%08x, wrong file or byte order?" % magic)
+    if version != TRACE_VERSION:
+        raise ValueError("unsupported trace version %d" % version)
+    if record_size != struct.calcsize(record_format):
+        raise ValueError("unexpected record size %d" % record_size)
+    if len(data) < header_size + nbr_records * record_size:
+        raise ValueError("dump holds less than %d records" % nbr_records)
+
+    if write_count <= nbr_records:
+        indexes = range(write_count)
+    else:
+        first = write_count % nbr_records
+        indexes = [(first + i) % nbr_records for i in range(nbr_records)]
+
+    records = [struct.unpack_from(record_format, data,
+                                  header_size + index * record_size)
+               for index in indexes]
+    return timestamp_hz, write_count, records
+
+
+def convert(records, timestamp_hz):
+    """Returns the list of Chrome trace events for the records."""
+    events = []
+    pids = set()
+    running_pid = None
+    running_since = None
+    wraps = 0
+    last_timestamp = None
+    first_ts = None
+
+    def add_slice(pid, start, end):
+        events.append({"name": "running", "ph": "X", "pid": 0, "tid": pid,
+                       "ts": start, "dur": end - start})
+
+    for timestamp, event, pid, arg in records:
+        # Time stamps are 32 bits and wrap around.
+        if last_timestamp is not None and timestamp < last_timestamp:
+            wraps += 1
+        last_timestamp = timestamp
+        ts = (timestamp + (wraps << 32)) * 1e6 / timestamp_hz
+
+        if first_ts is None:
+            first_ts = ts
+
+        pids.add(pid)
+        if event == EVENT_SWITCH:
+            pids.add(arg)
+            if running_pid is None:
+                # The process switched out has run since before the oldest
+                # record.
+                add_slice(pid, first_ts, ts)
+            elif running_pid == pid:
+                add_slice(pid, running_since, ts)
+            running_pid = arg
+            running_since = ts
+        else:
+            events.append({"name": EVENT_NAMES.get(event, str(event)),
+                           "ph": "i", "s": "t", "pid": 0, "tid": pid,
+                           "ts": ts, "args": event_args(event, arg)})
+
+    if running_pid is not None and last_timestamp is not None:
+        add_slice(running_pid, running_since,
+                  (last_timestamp + (wraps << 32)) * 1e6 / timestamp_hz)
+
+    events.append({"name": "process_name", "ph": "M", "pid": 0,
+                   "args": {"name": "rtos"}})
+    for pid in sorted(pids):
+        name = "interrupts" if pid == NO_PID else "pid %d" % pid
+        events.append({"name": "thread_name", "ph": "M", "pid": 0,
+                       "tid": pid, "args": {"name": name}})
+    return events
+
+
+def main():
+    parser = argparse.ArgumentParser(
+        description="Convert a kernel trace dump to Chrome trace JSON.")
+    parser.add_argument("dump", help="raw dump of rtos_trace")
+    parser.add_argument("-o", "--output", help="output file, default stdout")
+    parser.add_argument("--hz", type=float,
+                        help="time stamp frequency, overrides the header")
+    parser.add_argument("--big-endian", action="store_true",
+                        help="the dump is from a big-endian target")
+    options = parser.parse_args()
+
+    with open(options.dump, "rb") as dump:
+        data = dump.read()
+
+    try:
+        timestamp_hz, write_count, records = read_trace(
+            data, ">" if options.big_endian else "<")
+    except ValueError as error:
+        sys.exit("%s: %s" % (options.dump, error))
+
+    if options.hz:
+        timestamp_hz = options.hz
+    trace = {"traceEvents": convert(records, timestamp_hz),
+             "displayTimeUnit": "ns",
+             "otherData": {"records_written": write_count,
+                           "records_dropped": write_count - len(records)}}
+
+    if options.output:
+        with open(options.output, "w") as output:
+            json.dump(trace, output, indent=1)
+    else:
+        json.dump(trace, sys.stdout, indent=1)
+
+
+if __name__ == "__main__":
+    main()